@@ -9,20 +9,56 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #ifndef NO_EIGEN
 #include <Eigen/Dense>
 #endif
 
+#include <QApplication>
+#include <QCoreApplication>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QEvent>
 #include <QEventLoop>
+#include <QFileInfo>
 #include <QGraphicsLayout>
+#include <QGraphicsScene>
+#include <QGraphicsView>
+#include <QHash>
+#include <QImage>
+#include <QMouseEvent>
+#include <QPageSize>
+#include <QPainter>
 #include <QPair>
+#include <QPdfWriter>
+#include <QThread>
+#include <QTimer>
+#include <QTransform>
+#include <QWheelEvent>
+#include <QtMath>
+
+#ifndef NO_SVG
+#include <QtSvg/QSvgGenerator>
+#endif
 
 #include <QtCharts/QCategoryAxis>
 #include <QtCharts/QChart>
 #include <QtCharts/QChartView>
+#include <QtCharts/QLegendMarker>
 #include <QtCharts/QLineSeries>
 #include <QtCharts/QScatterSeries>
 #include <QtCharts/QValueAxis>
@@ -33,32 +69,13 @@
 #define PLT_ARG_NAMESPACE
 #endif
 
-#ifdef _MSC_VER
-#if _MSC_VER >= 1900
-#define PLT_CONSTEXPR constexpr
-#else
-#define PLT_CONSTEXPR
-#endif
-#else
-#define PLT_CONSTEXPR constexpr
-#endif
-
 #define MO_KEYWORD_INPUT(name, type)                                           \
   namespace tag {                                                              \
   struct name {                                                                \
     typedef type Type;                                                         \
     typedef const Type &ConstRef;                                              \
-    typedef Type &Ref;                                                         \
     typedef ConstRef StorageType;                                              \
     typedef const void *VoidType;                                              \
-    template <typename T> static PLT_CONSTEXPR bool AllowedType() {            \
-      return std::is_same<Type, T>::value;                                     \
-    }                                                                          \
-    static VoidType GetPtr(const Type &arg) { return &arg; }                   \
-    template <class T> static VoidType GetPtr(const T &arg) {                  \
-      (void)arg;                                                               \
-      return nullptr;                                                          \
-    }                                                                          \
   };                                                                           \
   }                                                                            \
   namespace PLT_ARG_NAMESPACE {                                                \
@@ -66,28 +83,6 @@
       kwargs::TKeyword<tag::name>::instance;                                   \
   }
 
-#define MO_KEYWORD_OUTPUT(name, type)                                          \
-  namespace tag {                                                              \
-  struct name {                                                                \
-    typedef type Type;                                                         \
-    typedef const Type &ConstRef;                                              \
-    typedef Type &Ref;                                                         \
-    typedef Ref StorageType;                                                   \
-    typedef void *VoidType;                                                    \
-    template <typename T> static PLT_CONSTEXPR bool AllowedType() {            \
-      return std::is_same<Type, T>::value;                                     \
-    }                                                                          \
-    static VoidType GetPtr(Type &arg) { return &arg; }                         \
-    template <class T> static VoidType GetPtr(const T &arg) {                  \
-      (void)arg;                                                               \
-      return nullptr;                                                          \
-    }                                                                          \
-  };                                                                           \
-  }                                                                            \
-  namespace PLT_ARG_NAMESPACE {                                                \
-  static kwargs::TKeyword<name> &name = kwargs::TKeyword<name>::instance;      \
-  }
-
 namespace kwargs {
 struct TaggedBase {};
 template <class Tag> struct TaggedArgument : public TaggedBase {
@@ -109,105 +104,8 @@ template <class Tag> struct TKeyword {
 template <class T> TKeyword<T> TKeyword<T>::instance;
 } // namespace kwargs
 
-template <int N, typename... T> struct ArgType;
-
-template <typename T0, typename... T> struct ArgType<0, T0, T...> {
-  typedef T0 type;
-};
-template <int N, typename T0, typename... T> struct ArgType<N, T0, T...> {
-  typedef typename ArgType<N - 1, T...>::type type;
-};
-
-template <class Tag, bool Infer = false> typename Tag::VoidType GetKeyImpl() {
-  return 0;
-}
-
-template <class T, class U> PLT_CONSTEXPR int CountTypeImpl(const U &value) {
-  return std::is_same<T, U>::value ? 1 : 0;
-}
-
-template <class T, class U, class... Args>
-PLT_CONSTEXPR int CountTypeImpl(const U &value, const Args &...args) {
-  return CountTypeImpl<T, Args...>(args...) +
-         (std::is_same<T, U>::value ? 1 : 0);
-}
-
-template <class T, class... Args>
-PLT_CONSTEXPR int CountType(const Args &...args) {
-  return CountTypeImpl<T, Args...>(args...);
-}
-
-template <size_t N, typename... Args>
-auto GetPositionalInput(Args &&...as)
-    -> decltype(std::get<N>(std::forward_as_tuple(std::forward<Args>(as)...))) {
-  return std::get<N>(std::forward_as_tuple(std::forward<Args>(as)...));
-}
-
-template <class Tag, bool Infer = false, class T, class... Args>
-typename std::enable_if<std::is_base_of<kwargs::TaggedBase, T>::value,
-                        typename Tag::VoidType>::type
-GetKeyImpl(const T &arg, const Args &...args) {
-  return std::is_same<typename T::TagType, Tag>::value
-             ? const_cast<void *>(arg.get())
-             : const_cast<void *>(GetKeyImpl<Tag, Infer, Args...>(args...));
-}
-
-template <class Tag, bool Infer = false, class T, class... Args>
-typename std::enable_if<!std::is_base_of<kwargs::TaggedBase, T>::value,
-                        typename Tag::VoidType>::type
-GetKeyImpl(const T &arg, const Args &...args) {
-#ifdef __GNUC__
-  // static_assert(CountType<typename Tag::Type>(arg, args...) <= 1, "Cannot
-  // infer type when there are multiple variadic Params with desired type");
-#endif
-  return Tag::template AllowedType<T>() && Infer
-             ? // This infers the type
-             Tag::GetPtr(arg)
-             : const_cast<void *>(GetKeyImpl<Tag, Infer, Args...>(args...));
-}
-
-template <class Tag, bool Infer = false, class... Args>
-typename Tag::ConstRef GetKeywordInput(const Args &...args) {
-  const void *ptr = GetKeyImpl<Tag, Infer>(args...);
-  assert(ptr);
-  return *(static_cast<const typename Tag::Type *>(ptr));
-}
-
-template <class Tag, bool Infer = false, class... Args>
-typename Tag::ConstRef GetKeywordInputDefault(typename Tag::ConstRef def,
-                                              const Args &...args) {
-  const void *ptr = GetKeyImpl<Tag, Infer>(args...);
-  if (ptr)
-    return *static_cast<const typename Tag::Type *>(ptr);
-  return def;
-}
-
-template <class Tag, bool Infer = false, class... Args>
-const typename Tag::Type *GetKeywordInputOptional(const Args &...args) {
-  const void *ptr = GetKeyImpl<Tag, Infer>(args...);
-  if (ptr)
-    return static_cast<const typename Tag::Type *>(ptr);
-  return nullptr;
-}
-
-template <class Tag, bool Infer = false, class... Args>
-typename Tag::Ref GetKeywordOutput(const Args &...args) {
-  static_assert(!std::is_const<typename Tag::VoidType>::value,
-                "Tag type is not an output tag");
-  void *ptr = GetKeyImpl<Tag, Infer>(args...);
-  assert(ptr);
-  return *(static_cast<typename Tag::Type *>(ptr));
-}
-
-template <class Tag, bool Infer = false, class... Args>
-typename Tag::Type *GetKeywordOutputOptional(const Args &...args) {
-  static_assert(!std::is_const<typename Tag::VoidType>::value,
-                "Tag type is not an output tag");
-  void *ptr = GetKeyImpl<Tag, Infer>(args...);
-  if (ptr)
-    return (static_cast<typename Tag::Type *>(ptr));
-  return nullptr;
-}
+// the bounds given to range=, as qMakePair(min, max)
+typedef QPair<qreal, qreal> ValueRange;
 
 MO_KEYWORD_INPUT(x, Eigen::ArrayXf)
 MO_KEYWORD_INPUT(y, Eigen::ArrayXf)
@@ -218,6 +116,11 @@ MO_KEYWORD_INPUT(linewidth, quint32)
 MO_KEYWORD_INPUT(alpha, qreal)
 MO_KEYWORD_INPUT(edgecolor, QColor)
 MO_KEYWORD_INPUT(markersize, qreal)
+MO_KEYWORD_INPUT(decimate, QString)
+MO_KEYWORD_INPUT(capacity, int)
+MO_KEYWORD_INPUT(density, QString)
+MO_KEYWORD_INPUT(bins, int)
+MO_KEYWORD_INPUT(range, ValueRange)
 
 // The below works on MSVC 2015
 /*template<typename T, typename Enable = void>
@@ -226,11 +129,53 @@ template<typename T>
 struct is_matrix_expression<T, decltype(std::declval<Eigen::ArrayXf>() =
 std::declval<T>(), void())> : std::true_type {};*/
 
-// Not sure if there are limitations to this but it seems to work on 2013
+// True for arrays, matrices, maps and any expression built from them. Some
+// of them, like VectorBlock, derive from the DenseBase of another type.
+template <typename Derived>
+std::true_type is_dense_base_test(const Eigen::DenseBase<Derived> *);
+std::false_type is_dense_base_test(...);
+
 template <typename Derived>
 struct is_matrix_expression
-    : std::is_base_of<Eigen::ArrayBase<std::decay<Derived>>,
-                      std::decay<Derived>> {};
+    : decltype(is_dense_base_test(
+          std::declval<typename std::decay<Derived>::type *>())) {};
+
+// True when the coefficients of Derived are stored contiguously in memory,
+// so they can be read in place through an Eigen::Ref
+template <typename Derived>
+struct has_direct_access
+    : std::integral_constant<bool,
+                             (Derived::Flags & Eigen::DirectAccessBit) &&
+                                 Derived::InnerStrideAtCompileTime == 1> {};
+
+// True for the std::vector and QVector of numbers that plot() reads in place
+template <typename T>
+struct is_sample_scalar
+    : std::integral_constant<bool, std::is_arithmetic<T>::value &&
+                                       !std::is_same<T, bool>::value> {};
+
+template <typename T> struct is_sample_container : std::false_type {};
+template <typename T>
+struct is_sample_container<std::vector<T>> : is_sample_scalar<T> {};
+template <typename T>
+struct is_sample_container<QVector<T>> : is_sample_scalar<T> {};
+
+// True for anything plot() accepts as a column of samples
+template <typename T>
+struct is_plot_data
+    : std::integral_constant<
+          bool, is_matrix_expression<T>::value ||
+                    is_sample_container<typename std::decay<T>::type>::value> {
+};
+
+// Read-only view over a column of samples of any type, without copies
+template <typename Scalar>
+using SampleRef = Eigen::Ref<const Eigen::Array<Scalar, Eigen::Dynamic, 1>>;
+
+// Samples taken at a fixed step, as made by ArrayXd::LinSpaced(). Series
+// with such x only store the first value and the step of x.
+typedef std::decay<decltype(Eigen::ArrayXd::LinSpaced(0, 0.0, 0.0))>::type
+    UniformX;
 
 /* Debug control */
 
@@ -248,765 +193,5889 @@ struct is_matrix_expression
 #define DEFAULT_LEGEND ""
 #define DEFAULT_MARKER "-"
 #define DEFAULT_ALPHA 1.0f
-#define DEFAULT_COLOR "none"
-#define DEFAULT_EDGECOLOR "none"
 #define DEFAULT_LINEW 2
 #define DEFAULT_MARKERSZ 6.0f
+#define DEFAULT_DECIMATE "none"
+#define DEFAULT_DENSITY "auto"
+#define STYLE_CACHE_SIZE 1024 // format strings cached per thread by PlotStyle
+#define DEFAULT_DENSITY_POINTS 100000 // scatter plots drawn as a density image
+#define BINNING_POINTS_PER_THREAD 65536
+#define DEFAULT_CMAP "viridis"
+#define DEFAULT_HIST2D_BINS 10
+#define DEFAULT_GRIDSIZE 100
+#define COLORMAP_PACKET 16 // values of imshow() normalized at once
+#define COLORMAP_TILE_ROWS 256
+#define COLORMAP_TILE_COLS 32
+#define COLORMAP_PIXELS_PER_THREAD 262144
+#define DEFAULT_HIST_BINS 10
+#define HISTOGRAM_PACKET 16 // samples of hist() binned at once
+#define DEFAULT_CAPACITY 0
+#define RING_BLOCK 256 // samples of a ring buffer bounded together
+#define DEFAULT_WIDTH 600
+#define DEFAULT_HEIGHT 400
+#define DEFAULT_DPI 96
+#define DEFAULT_PANEL_WIDTH 320 // size of a chart of subplots()
+#define DEFAULT_PANEL_HEIGHT 240
+#define DEFAULT_INGEST_CAPACITY 65536
+#define DEFAULT_DRAIN_MS 16
+#define DEFAULT_MAPPED_POINTS 16384 // blocks a mapped series is reduced to per view
+#define MAPPED_CHUNK_BYTES (16 << 20)
+#define MAPPED_BLOCK 1024 // samples bounded by a block of the index of a MappedArray
+#define LOD_FANOUT 8 // samples, then blocks, bounded by a block of the LOD index
+#define LOD_SAMPLES_PER_THREAD (1 << 22)
 
 #ifdef NO_EIGEN
 #error COMPILATION MUST GO THOUGH WITHOUT EIGEN CODE.
 #endif
 
-class Madplotlib {
-public:
-  Madplotlib(bool isWidget = false)
-      : _chart(NULL), _chartView(NULL), _isWidget(isWidget) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "Madplotlib(): isWidget=" << isWidget;
-#endif
-    _xAxisTop = _xAxisBottom = _yAxisLeft = _yAxisRight = nullptr;
-    _chart = new QtCharts::QChart();
+/* Plot options */
 
-    _chartView = new QtCharts::QChartView(_chart);
+// Number of times T appears in Args
+template <class T, class... Args>
+struct count_type : std::integral_constant<int, 0> {};
+template <class T, class A, class... Args>
+struct count_type<T, A, Args...>
+    : std::integral_constant<int, std::is_same<T, A>::value +
+                                      count_type<T, Args...>::value> {};
+
+// True when no keyword appears twice in Args
+template <class... Args> struct unique_keywords : std::true_type {};
+template <class A, class... Args>
+struct unique_keywords<A, Args...>
+    : std::integral_constant<
+          bool, (!std::is_base_of<kwargs::TaggedBase, A>::value ||
+                 count_type<A, Args...>::value == 0) &&
+                    unique_keywords<Args...>::value> {};
+
+template <class T> struct dependent_false : std::false_type {};
+
+/* PlotStyle: the style described by a format string like the ones of
+ * matplotlib, such as "r--o" (red dashed line with circle markers), "ks"
+ * (black squares) or "label=Flat". The format string is made of:
+ *   a line:   "-" solid, "--" dashed, "." or ":" dotted, "-." dash-dot;
+ *   a marker: "o" circle, "s" square. Without a line, it's a scatter plot;
+ *   a color:  one of "bgrcmykw";
+ * or of a single "label=text". Each string is parsed once per thread and
+ * cached, so giving plot() the same string again costs a hash lookup. The
+ * first STYLE_CACHE_SIZE strings seen by a thread are cached and kept for
+ * its lifetime; later ones are parsed every time, so labels made up on the
+ * fly can't exhaust the memory.
+ */
+struct PlotStyle {
+  enum Line { LineUnset, LineSolid, LineDashed, LineDotted, LineDashDot };
+  enum Marker { MarkerNone, MarkerCircle, MarkerSquare };
 
-    _enableGrid = false;
-    _customLimits = false;
-    _xMin = _xMax = _yMin = _yMax = 0;
+  Line line = LineUnset;
+  Marker marker = MarkerNone;
+  QColor color;  // invalid when the format string has no color
+  QString label; // null when the format string has no label
+  bool valid = true;
 
-    _showXticks = _showYticks = SHOW_TICK;
-    _xTickCount = 7;
-    _yTickCount = 5;
+  /* parse(): the style of spec, from the cache of the thread if possible.
+   */
+  static PlotStyle parse(const QString &spec) {
+    static thread_local QHash<QString, PlotStyle> cache;
 
-    _colorIdx = 0;
-    _colors.push_back(QColor(0x1f77b4));
-    _colors.push_back(QColor(0xff7f0e));
-    _colors.push_back(QColor(0x2ca02c));
-    _colors.push_back(QColor(0xd62728));
-    _colors.push_back(QColor(0x9467bd));
-    _colors.push_back(QColor(0x8c564b));
-    _colors.push_back(QColor(0xe377c2));
-    _colors.push_back(QColor(0x7f7f7f));
-    _colors.push_back(QColor(0xbcbd22));
-    _colors.push_back(QColor(0x17becf));
-  }
+    auto itr = cache.constFind(spec);
+    if (itr != cache.constEnd())
+      return *itr;
 
-  void axis(QString cmd) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "axis(): cmd=" << cmd;
-#endif
-    if (cmd == "off") {
-      _showYticks = _showXticks = HIDE_TICK;
-    } else if (cmd == "xoff") {
-      _showXticks = HIDE_TICK;
-    } else if (cmd == "yoff") {
-      _showYticks = HIDE_TICK;
-    } else {
-      qCritical() << "axis()!!! options are 'off', 'xoff' and 'yoff'.";
-      return;
-    }
+    const PlotStyle style = compile(spec);
+    if (cache.size() < STYLE_CACHE_SIZE)
+      cache.insert(spec, style);
+    return style;
   }
 
-  /* axis(): gets the current axes limits [xMin, xMax, yMin, yMax].
+  /* parse(): same as above, for string literals like "r--". They are looked
+   * up in a cache of their own, without converting them to a QString, which
+   * would allocate on every call.
    */
-  void axis(qreal *xMin, qreal *xMax, qreal *yMin, qreal *yMax) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "axis(): _xMin=" << _xMin << " _xMax=" << _xMax
-             << " _yMin=" << _yMin << " _yMax=" << _yMax;
-#endif
-    *xMin = _xMin;
-    *xMax = _xMax;
-    *yMin = _yMin;
-    *yMax = _yMax;
+  static PlotStyle parse(const char *spec) {
+    static thread_local QHash<QByteArray, PlotStyle> cache;
+
+    // wraps spec without copying it, only the keys inserted are copies
+    const QByteArray key = QByteArray::fromRawData(spec, qstrlen(spec));
+    auto itr = cache.constFind(key);
+    if (itr != cache.constEnd())
+      return *itr;
+
+    const PlotStyle style = compile(QString::fromUtf8(spec));
+    if (cache.size() < STYLE_CACHE_SIZE)
+      cache.insert(QByteArray(key.constData(), key.size()), style);
+    return style;
   }
 
-  /* axis(): sets the viewport of the axis by a list of [xMin, xMax, yMin,
-   * yMax].
+  /* compile(): parses spec, without the cache.
    */
-  void axis(const qreal &xMin, qreal xMax, const qreal &yMin,
-            const qreal &yMax) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "axis(): xMin=" << xMin << " xMax=" << xMax << " yMin=" << yMin
-             << " yMax=" << yMax;
-#endif
-    _xMin = xMin;
-    _xMax = xMax;
-    _yMin = yMin;
-    _yMax = yMax;
-    _customLimits = true;
+  static PlotStyle compile(const QString &spec) {
+    PlotStyle style;
+
+    const int equals = spec.indexOf(QChar('='));
+    if (equals >= 0) {
+      if (spec.left(equals).trimmed() == "label")
+        style.label = spec.mid(equals + 1).trimmed();
+      else
+        style.valid = false;
+      return style;
+    }
+
+    const int n = spec.size();
+    bool hasColor = false;
+    for (int i = 0; i < n && style.valid; i++) {
+      const char c = spec.at(i).toLatin1();
+      const char next = (i + 1 < n) ? spec.at(i + 1).toLatin1() : 0;
+
+      if (c == '-' || c == '.' || c == ':') {
+        style.valid = (style.line == LineUnset);
+        if (c == '-' && next == '-')
+          style.line = LineDashed, i++;
+        else if (c == '-' && next == '.')
+          style.line = LineDashDot, i++;
+        else if (c == '-')
+          style.line = LineSolid;
+        else
+          style.line = LineDotted;
+      } else if (c == 'o' || c == 's') {
+        style.valid = (style.marker == MarkerNone);
+        style.marker = (c == 'o') ? MarkerCircle : MarkerSquare;
+      } else if (_color(c).isValid()) {
+        style.valid = !hasColor;
+        style.color = _color(c);
+        hasColor = true;
+      } else {
+        style.valid = false;
+      }
+    }
+
+    return style;
   }
 
-  /* xlim(): sets the x limits of the current axes.
+  /* labelOf(): the text of a label keyword, which may be written either as
+   * "text" or as "label=text".
    */
-  void xlim(const qreal &xMin, const qreal &xMax) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "xlim(): xMin=" << xMin << " xMax=" << xMax;
-#endif
-    _xMin = xMin;
-    _xMax = xMax;
-    _customLimits = true;
+  static QString labelOf(const QString &spec) {
+    if (spec.indexOf(QChar('=')) < 0)
+      return spec;
+    return parse(spec).label;
   }
 
-  /* ylim(): sets the x limits of the current axes.
+  /* merge(): the parts defined by other replace the ones of this style.
    */
-  void ylim(const qreal &yMin, const qreal &yMax) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "ylim(): yMin=" << yMin << " yMax=" << yMax;
-#endif
-    _yMin = yMin;
-    _yMax = yMax;
-    _customLimits = true;
+  void merge(const PlotStyle &other) {
+    if (other.line != LineUnset)
+      line = other.line;
+    if (other.marker != MarkerNone)
+      marker = other.marker;
+    if (other.color.isValid())
+      color = other.color;
+    if (!other.label.isNull())
+      label = other.label;
+    valid = valid && other.valid;
   }
 
-  /* title(): defines the title of the chart.
+  bool isScatter() const { return marker != MarkerNone && line == LineUnset; }
+
+  Qt::PenStyle penStyle() const {
+    switch (line) {
+    case LineDashed:
+      return Qt::DashLine;
+    case LineDotted:
+      return Qt::DotLine;
+    case LineDashDot:
+      return Qt::DashDotLine;
+    default:
+      return Qt::SolidLine;
+    }
+  }
+
+  bool operator==(const PlotStyle &other) const {
+    return line == other.line && marker == other.marker &&
+           color == other.color && label == other.label &&
+           valid == other.valid;
+  }
+
+  bool operator!=(const PlotStyle &other) const { return !(*this == other); }
+
+  // the single letter colors of matplotlib
+  static QColor _color(char c) {
+    switch (c) {
+    case 'b':
+      return QColor(0, 0, 255);
+    case 'g':
+      return QColor(0, 128, 0);
+    case 'r':
+      return QColor(255, 0, 0);
+    case 'c':
+      return QColor(0, 191, 191);
+    case 'm':
+      return QColor(191, 0, 191);
+    case 'y':
+      return QColor(191, 191, 0);
+    case 'k':
+      return QColor(0, 0, 0);
+    case 'w':
+      return QColor(255, 255, 255);
+    default:
+      return QColor();
+    }
+  }
+};
+
+inline uint qHash(const PlotStyle &style, uint seed = 0) {
+  return qHash(style.label, seed) ^ style.color.rgba() ^
+         (uint(style.line) << 4 | uint(style.marker) << 1 | uint(style.valid));
+}
+
+/* PlotOptions: the keywords given to plot(), each one folded at compile time
+ * into its own field. Keywords that were not given keep the defaults, which
+ * are built without any lookup or allocation.
+ */
+struct PlotOptions {
+  enum Decimation {
+    DecimateNone,
+    DecimateM4,
+    DecimateLTTB,
+    DecimateLOD,
+    DecimateUnknown
+  };
+  enum Density { DensityAuto, DensityOn, DensityOff, DensityUnknown };
+
+  PlotStyle style; // the marker keyword, format strings and the label
+  qreal alpha = DEFAULT_ALPHA;
+  QColor color;     // invalid: the next color of the cycle
+  quint32 linewidth = DEFAULT_LINEW;
+  QColor edgecolor; // invalid: same as the color
+  qreal markersize = DEFAULT_MARKERSZ;
+  Decimation decimate = DecimateNone;
+  Density density = DensityAuto;
+  int capacity = DEFAULT_CAPACITY;
+  int bins = DEFAULT_HIST_BINS; // hist() only, like range
+  ValueRange range = qMakePair(
+      std::numeric_limits<qreal>::quiet_NaN(), // NaN: the bounds of the
+      std::numeric_limits<qreal>::quiet_NaN()); // samples
+
+  template <class... Args> static PlotOptions from(const Args &...args) {
+    static_assert(unique_keywords<Args...>::value,
+                  "plot(): the same keyword was given more than once");
+
+    PlotOptions options;
+    int unpack[] = {0, (options.set(args), 0)...};
+    (void)unpack;
+    return options;
+  }
+
+  void set(const kwargs::TaggedArgument<tag::marker> &arg) {
+    const PlotStyle marker = PlotStyle::parse(value(arg));
+    if (!marker.valid || !marker.label.isNull()) {
+      qCritical() << "plot(x,y): unknown marker '" << value(arg) << "'.";
+      style.valid = false;
+      return;
+    }
+    style.merge(marker);
+  }
+  void set(const kwargs::TaggedArgument<tag::label> &arg) {
+    style.label = PlotStyle::labelOf(value(arg));
+  }
+  void set(const kwargs::TaggedArgument<tag::alpha> &arg) {
+    alpha = value(arg);
+  }
+  void set(const kwargs::TaggedArgument<tag::color> &arg) {
+    color = value(arg);
+  }
+  void set(const kwargs::TaggedArgument<tag::linewidth> &arg) {
+    linewidth = value(arg);
+  }
+  void set(const kwargs::TaggedArgument<tag::edgecolor> &arg) {
+    edgecolor = value(arg);
+  }
+  void set(const kwargs::TaggedArgument<tag::markersize> &arg) {
+    markersize = value(arg);
+  }
+  void set(const kwargs::TaggedArgument<tag::capacity> &arg) {
+    capacity = value(arg);
+  }
+  void set(const kwargs::TaggedArgument<tag::bins> &arg) {
+    bins = value(arg);
+  }
+  void set(const kwargs::TaggedArgument<tag::range> &arg) {
+    range = value(arg);
+  }
+
+  void set(const kwargs::TaggedArgument<tag::decimate> &arg) {
+    const QString &name = value(arg);
+    if (name == DEFAULT_DECIMATE)
+      decimate = DecimateNone;
+    else if (name == "m4")
+      decimate = DecimateM4;
+    else if (name == "lttb")
+      decimate = DecimateLTTB;
+    else if (name == "lod")
+      decimate = DecimateLOD;
+    else {
+      qCritical() << "plot(x,y): unknown decimation '" << name << "'.";
+      decimate = DecimateUnknown;
+    }
+  }
+
+  void set(const kwargs::TaggedArgument<tag::density> &arg) {
+    const QString &name = value(arg);
+    if (name == DEFAULT_DENSITY)
+      density = DensityAuto;
+    else if (name == "on")
+      density = DensityOn;
+    else if (name == "off")
+      density = DensityOff;
+    else {
+      qCritical() << "plot(x,y): unknown density '" << name << "'.";
+      density = DensityUnknown;
+    }
+  }
+
+  // keywords that plot() doesn't know about are caught by the compiler
+  template <class Tag> void set(const kwargs::TaggedArgument<Tag> &) {
+    static_assert(dependent_false<Tag>::value,
+                  "plot(): unknown keyword");
+  }
+
+  // Strings given without a keyword are format strings, like "r--", or
+  // "label=text". A bare label would be ambiguous: "r" is a color as much as
+  // a label, so anything else is rejected.
+  void set(const QString &spec) { mergeFormat(PlotStyle::parse(spec), spec); }
+  void set(const char *spec) { mergeFormat(PlotStyle::parse(spec), spec); }
+
+  template <class String>
+  void mergeFormat(const PlotStyle &other, const String &spec) {
+    if (!other.valid)
+      qCritical() << "plot(x,y): unknown format '" << spec
+                  << "', a label is given as 'label=" << spec << "'.";
+    style.merge(other);
+  }
+
+  // any other value needs its keyword, like color=QColor(255, 0, 0)
+  template <class T> void set(const T &) {
+    static_assert(dependent_false<T>::value,
+                  "plot(): values other than format strings need a keyword, "
+                  "like color=QColor(255, 0, 0)");
+  }
+
+  template <class Tag>
+  static const typename Tag::Type &
+  value(const kwargs::TaggedArgument<Tag> &arg) {
+    return *static_cast<const typename Tag::Type *>(arg.get());
+  }
+};
+
+/* SeriesHandle: identifies a series created by plot(). It stays valid until
+ * the series is removed, and is then never mistaken for a newer series, even
+ * if the newer one takes over the same slot.
+ */
+struct SeriesHandle {
+  int slot;           // index in the slot array of Madplotlib, -1 if none
+  quint32 generation; // number of times the slot had been released before
+
+  SeriesHandle() : slot(-1), generation(0) {}
+  SeriesHandle(int s, quint32 g) : slot(s), generation(g) {}
+
+  bool isValid() const { return slot >= 0; }
+  bool operator==(const SeriesHandle &other) const {
+    return slot == other.slot && generation == other.generation;
+  }
+  bool operator!=(const SeriesHandle &other) const { return !(*this == other); }
+};
+
+/* SampleQueue: samples pushed by any number of threads, on their way to a
+ * series. It's a bounded lock-free queue (D. Vyukov's design): producers
+ * claim a cell with a single compare-and-swap on the tail and publish it
+ * through the sequence number of the cell, so they never wait for each other
+ * or for the figure. The figure is the only consumer.
+ * When the queue is full, push() fails and the sample is counted as dropped,
+ * which is the cue for producers to slow down or send less data.
+ * uniform tells if the series is sampled at a fixed step, so its x can be
+ * left out.
+ */
+class SampleQueue {
+public:
+  /* Stats: what went through the queue so far.
    */
-  void title(QString string) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "title(): string=" << string;
-#endif
-    _title = string;
+  struct Stats {
+    quint64 pushed;  // samples accepted by push()
+    quint64 dropped; // samples refused because the queue was full or closed
+    quint64 drained; // samples handed to the series
+    int pending;     // samples waiting in the queue
+    int highWater;   // most samples ever found waiting by a drain
+    int capacity;
+  };
+
+  SampleQueue(int capacity, bool uniform)
+      : _uniform(uniform), _tail(0), _head(0), _dropped(0), _highWater(0),
+        _closed(false) {
+    int size = 2;
+    while (size < capacity)
+      size *= 2;
+    _cells = std::vector<Cell>(size);
+    for (int i = 0; i < size; i++)
+      _cells[i].sequence.store(i, std::memory_order_relaxed);
+    _mask = size - 1;
   }
 
-  /* xlabel(): defines the label displayed below the x axis.
+  SampleQueue(const SampleQueue &) = delete;
+  SampleQueue &operator=(const SampleQueue &) = delete;
+
+  /* push(): queues a sample. Returns false if it was dropped.
    */
-  void xlabel(QString label) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "xlabel(): label=" << label;
-#endif
-    _xLabel = label;
+  bool push(float x, float y) {
+    quint64 pos = _tail.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+      if (_closed.load(std::memory_order_relaxed))
+        return _drop(1);
+
+      cell = &_cells[pos & _mask];
+      const quint64 sequence = cell->sequence.load(std::memory_order_acquire);
+      const qint64 diff = qint64(sequence) - qint64(pos);
+      if (diff == 0) {
+        if (_tail.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return _drop(1); // full: the consumer hasn't freed this cell yet
+      } else {
+        pos = _tail.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->x = x;
+    cell->y = y;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
   }
 
-  /* ylabel(): defines the label displayed to the left of the y axis.
+  /* push(): same as above, for series sampled at a fixed step, whose x is
+   * derived from its step. Any other series needs x: the sample is dropped.
    */
-  void ylabel(QString label) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "ylabel(): label=" << label;
-#endif
-    _yLabel = label;
+  bool push(float y) {
+    if (!_uniform)
+      return _drop(1);
+    return push(std::numeric_limits<float>::quiet_NaN(), y);
   }
 
-  /* legend(): defines the position of the legend label inside the chart.
+  /* push(): queues n samples, in order. Returns how many were accepted: the
+   * ones after the first sample dropped are dropped as well. x may be NULL
+   * for series sampled at a fixed step.
    */
-  void legend() { _legendPos = "lower center"; }
+  int push(const float *x, const float *y, int n) {
+    if (!x && !_uniform) {
+      _drop(n);
+      return 0;
+    }
+    for (int i = 0; i < n; i++)
+      if (!push(x ? x[i] : std::numeric_limits<float>::quiet_NaN(), y[i])) {
+        _drop(n - i - 1);
+        return i;
+      }
+    return n;
+  }
 
-  /* legend(): defines the position of the legend label inside the chart.
+  /* pop(): moves every published sample to x and y, which grow as needed.
+   * Returns the number of samples. Must only be called by the consumer.
    */
-  void legend(QString cmd) { _legendPos = _parseLegendPos(cmd); }
+  int pop(Eigen::ArrayXf &x, Eigen::ArrayXf &y) {
+    const quint64 head = _head.load(std::memory_order_relaxed);
+    const int pending = static_cast<int>(
+        std::min<quint64>(_tail.load(std::memory_order_relaxed) - head,
+                          _mask + 1));
+    if (pending > _highWater.load(std::memory_order_relaxed))
+      _highWater.store(pending, std::memory_order_relaxed);
+    if (x.rows() < pending) {
+      x.resize(pending);
+      y.resize(pending);
+    }
 
-  /* grid(): enables or disables the background grid of the chart.
+    int n = 0;
+    for (; n < pending; n++) {
+      Cell &cell = _cells[(head + n) & _mask];
+      if (cell.sequence.load(std::memory_order_acquire) != head + n + 1)
+        break; // claimed, but not written yet
+      x[n] = cell.x;
+      y[n] = cell.y;
+      cell.sequence.store(head + n + _mask + 1, std::memory_order_release);
+    }
+
+    _head.store(head + n, std::memory_order_relaxed);
+    return n;
+  }
+
+  /* close(): refuses every sample from now on, once the series is gone.
    */
-  void grid(bool status) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "grid(): status=" << status;
-#endif
-    _enableGrid = status;
+  void close() { _closed.store(true); }
+
+  Stats stats() const {
+    Stats stats;
+    stats.pushed = _tail.load(std::memory_order_relaxed);
+    stats.drained = _head.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.pending = static_cast<int>(stats.pushed - stats.drained);
+    stats.highWater = _highWater.load(std::memory_order_relaxed);
+    stats.capacity = static_cast<int>(_mask + 1);
+    return stats;
   }
 
-  /* savefig(): saves the chart displayed by show() as an image on the disk.
+private:
+  struct Cell {
+    std::atomic<quint64> sequence;
+    float x, y;
+  };
+
+  bool _drop(int n) {
+    _dropped.fetch_add(n, std::memory_order_relaxed);
+    return false;
+  }
+
+  const bool _uniform;
+  std::vector<Cell> _cells;
+  quint64 _mask;
+  std::atomic<quint64> _tail; // next position to be claimed
+  char _padding[64]; // producers and the consumer write to other cache lines
+  std::atomic<quint64> _head; // next position to be drained
+  std::atomic<quint64> _dropped;
+  std::atomic<int> _highWater;
+  std::atomic<bool> _closed;
+};
+
+/* MappedArray: a column of float32 samples in a file, either a .npy array
+ * or raw little endian floats, that plot() reads through memory mapping.
+ * The file is never loaded as a whole. Samples are mapped a window at a
+ * time and unmapped right after, so only the pages that are actually read
+ * come from the disk, and they don't stay resident.
+ * Once opened, the array is indexed on a thread of its own: the min and max
+ * of every MAPPED_BLOCK samples, then of every LOD_FANOUT blocks, and so on,
+ * like the LOD index of decimate="lod". Until it's done, plot() shows a
+ * preview of the file.
+ */
+class MappedArray : public std::enable_shared_from_this<MappedArray> {
+public:
+  /* Window: samples [first, first + size) of the array, as an Eigen::Map,
+   * mapped for as long as the window exists.
    */
-  void savefig(QString filename) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "savefig(): filename=" << filename;
-#endif
-    if (!_pixmap.isNull())
-      _pixmap.save(filename);
-    else if (_isWidget && _chartView) {
-      _pixmap = _chartView->grab();
+  class Window {
+  public:
+    Window() : _data(NULL), _samples(NULL), _size(0) {}
+    Window(const Window &) = delete;
+    Window &operator=(const Window &) = delete;
+    ~Window() {
+      if (_data)
+        _array->_unmap(_data);
     }
-  }
 
-  /* xticks(): sets the x-limits of the current tick locations and labels.
+    bool isValid() const { return _samples != NULL; }
+
+    Eigen::Map<const Eigen::ArrayXf> array() const {
+      return Eigen::Map<const Eigen::ArrayXf>(_samples, _size);
+    }
+
+  private:
+    friend class MappedArray;
+    std::shared_ptr<MappedArray> _array;
+    uchar *_data;
+    const float *_samples;
+    qint64 _size;
+  };
+
+  /* npy(): maps the float32 ('<f4') array of a .npy file. A 2D array must
+   * be in Fortran order, so that its columns are contiguous, unless it has
+   * a single column. Returns NULL if the file can't be used.
    */
-  void xticks(const Eigen::ArrayXf &values, const QVector<QString> &labels) {
+  static std::shared_ptr<MappedArray> npy(const QString &filename,
+                                          int column = 0) {
 #if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "xticks(): values.sz=" << values.rows()
-             << " labels.sz=" << labels.size();
+    qDebug() << "MappedArray::npy(): " << filename << " column=" << column;
 #endif
-    if (values.rows() == 0 && labels.size() == 0) {
-      _showXticks = HIDE_TICK;
-      return;
+    std::shared_ptr<MappedArray> array(new MappedArray(filename));
+    if (!array->_file.open(QIODevice::ReadOnly)) {
+      qCritical() << "MappedArray::npy()!!! can't open" << filename << ":"
+                  << array->_file.errorString();
+      return nullptr;
     }
 
-    if (values.rows() != labels.size()) {
-      qCritical() << "xticks(): the amount of values and labels must match!";
-      return;
+    // "\x93NUMPY", the version, and the size of the header: 2 bytes in
+    // version 1, 4 in the later ones
+    uchar preamble[12];
+    if (array->_file.read(reinterpret_cast<char *>(preamble), 10) != 10 ||
+        memcmp(preamble, "\x93NUMPY", 6) != 0) {
+      qCritical() << "MappedArray::npy()!!!" << filename
+                  << "isn't a .npy file.";
+      return nullptr;
     }
 
-    for (int i = 0; i < values.rows(); i++)
-      _xTicks.push_back(QPair<QString, qreal>(labels[i], values[i]));
+    qint64 headerSize = preamble[8] | (preamble[9] << 8);
+    qint64 offset = 10;
+    if (preamble[6] > 1) {
+      if (array->_file.read(reinterpret_cast<char *>(preamble) + 10, 2) != 2)
+        return nullptr;
+      headerSize = headerSize | (preamble[10] << 16) | (qint64(preamble[11]) << 24);
+      offset = 12;
+    }
 
-    _showXticks = SHOW_CUSTOM_TICK;
+    // the header is the repr() of a dict, such as
+    // {'descr': '<f4', 'fortran_order': False, 'shape': (1000, 2), }
+    const QString header =
+        QString::fromLatin1(array->_file.read(headerSize));
+    const QString descr = _npyField(header, "descr");
+    const bool fortran = _npyField(header, "fortran_order").startsWith("True");
+    const QString shape = _npyField(header, "shape");
+    QVector<qint64> dims;
+    for (const QString &dim : shape.split(',')) {
+      if (dim.trimmed().size())
+        dims.append(dim.trimmed().toLongLong());
+    }
+
+    if (descr != "<f4" || dims.isEmpty() || dims.size() > 2) {
+      qCritical() << "MappedArray::npy()!!!" << filename
+                  << "must hold a 1D or 2D float32 array, not" << header;
+      return nullptr;
+    }
+
+    const qint64 rows = dims[0];
+    const qint64 columns = (dims.size() > 1) ? dims[1] : 1;
+    if (column < 0 || column >= columns || (columns > 1 && !fortran)) {
+      qCritical() << "MappedArray::npy()!!! column" << column << "of"
+                  << filename << "isn't contiguous or doesn't exist.";
+      return nullptr;
+    }
+
+    if (!array->_setLayout(offset + headerSize + column * rows * 4, rows))
+      return nullptr;
+    array->_startIndex();
+    return array;
+  }
+
+  /* raw(): maps a file of little endian float32 samples, past offset bytes
+   * of header. Returns NULL if the file can't be used.
+   */
+  static std::shared_ptr<MappedArray> raw(const QString &filename,
+                                          qint64 offset = 0) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "MappedArray::raw(): " << filename << " offset=" << offset;
+#endif
+    std::shared_ptr<MappedArray> array(new MappedArray(filename));
+    if (!array->_file.open(QIODevice::ReadOnly)) {
+      qCritical() << "MappedArray::raw()!!! can't open" << filename << ":"
+                  << array->_file.errorString();
+      return nullptr;
+    }
+
+    if (offset < 0 || offset % 4) {
+      qCritical() << "MappedArray::raw()!!! offset must be a multiple of 4"
+                  << "but it is" << offset;
+      return nullptr;
+    }
+
+    if (!array->_setLayout(offset, (array->_file.size() - offset) / 4))
+      return nullptr;
+    array->_startIndex();
+    return array;
+  }
+
+  MappedArray(const MappedArray &) = delete;
+  MappedArray &operator=(const MappedArray &) = delete;
+  ~MappedArray() {
+    _cancel = true;
+    if (_indexer.joinable())
+      _indexer.join();
+  }
+
+  /* size(): number of samples, which may well be more than an int holds.
+   */
+  qint64 size() const { return _size; }
+
+  /* window(): maps the samples [first, first + n). The window is invalid
+   * if they are out of the array, or if the mapping failed.
+   */
+  std::unique_ptr<Window> window(qint64 first, qint64 n) {
+    std::unique_ptr<Window> window(new Window());
+    if (first < 0 || n <= 0 || first + n > _size)
+      return window;
+
+    window->_data = _map(first, n);
+    if (window->_data) {
+      window->_array = shared_from_this();
+      window->_samples = reinterpret_cast<const float *>(window->_data);
+      window->_size = n;
+    }
+    return window;
+  }
+
+  /* indexed(): true once the index of the array is built.
+   */
+  bool indexed() const { return _indexed; }
+
+  /* isSorted(): true if the samples never go down, and none is NaN. Only
+   * known once the array is indexed.
+   */
+  bool isSorted() const { return _indexed && _sorted; }
+
+  /* whenIndexed(): has the indexing thread call done once the index is
+   * built. Returns false, and forgets done, if it already is.
+   */
+  bool whenIndexed(std::function<void()> done) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_indexed)
+      return false;
+    _listeners.push_back(std::move(done));
+    return true;
+  }
+
+  /* bounds(): the bounds of the samples [first, last], from the index. Only
+   * the samples of the blocks cut by first or last are read. NaNs are
+   * skipped. Returns false if the array isn't indexed yet.
+   */
+  bool bounds(qint64 first, qint64 last, float &lo, float &hi) {
+    lo = std::numeric_limits<float>::infinity();
+    hi = -lo;
+    if (!_indexed || first < 0 || last < first || last >= _size)
+      return false;
+
+    const qint64 begin = (first + MAPPED_BLOCK - 1) / MAPPED_BLOCK;
+    const qint64 end = (last + 1) / MAPPED_BLOCK;
+    if (begin >= end)
+      return _scan(first, last + 1, lo, hi);
+    if (!_scan(first, begin * MAPPED_BLOCK, lo, hi) ||
+        !_scan(end * MAPPED_BLOCK, last + 1, lo, hi))
+      return false;
+
+    // the largest blocks that fit, growing up to the middle of the range
+    // and shrinking down to its end
+    size_t level = 0;
+    qint64 span = 1;
+    for (qint64 b = begin; b < end; b += span) {
+      while (level + 1 < _mins.size() && b % (span * LOD_FANOUT) == 0 &&
+             b + span * LOD_FANOUT <= end) {
+        span *= LOD_FANOUT;
+        level++;
+      }
+      while (b + span > end) {
+        span /= LOD_FANOUT;
+        level--;
+      }
+
+      const float min = _mins[level][b / span], max = _maxs[level][b / span];
+      lo = (min < lo) ? min : lo;
+      hi = (max > hi) ? max : hi;
+    }
+    return true;
+  }
+
+  /* search(): the number of samples < value, or <= value if upper is set,
+   * found by binary search: the array must be sorted. Once indexed, the
+   * first samples of the blocks narrow it down to a single block.
+   */
+  qint64 search(float value, bool upper) {
+    auto before = [&](float sample) {
+      return upper ? !(value < sample) : sample < value;
+    };
+
+    qint64 lo = 0, hi = _size;
+    if (isSorted()) {
+      // the min of a block of sorted samples is its first sample
+      const std::vector<float> &firsts = _mins[0];
+      const qint64 block =
+          std::partition_point(firsts.begin(), firsts.end(), before) -
+          firsts.begin();
+      if (block == 0)
+        return 0;
+      lo = (block - 1) * MAPPED_BLOCK;
+      hi = std::min(_size, block * MAPPED_BLOCK);
+
+      uchar *data = _map(lo, hi - lo);
+      if (!data)
+        return lo;
+      const float *samples = reinterpret_cast<const float *>(data);
+      const qint64 i =
+          std::partition_point(samples, samples + (hi - lo), before) - samples;
+      _unmap(data);
+      return lo + i;
+    }
+
+    while (lo < hi) {
+      const qint64 mid = lo + (hi - lo) / 2;
+      if (before(at(mid)))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  /* at(): sample i, read without mapping anything.
+   */
+  float at(qint64 i) {
+    float value = std::numeric_limits<float>::quiet_NaN();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (i >= 0 && i < _size && _file.seek(_offset + i * 4))
+      _file.read(reinterpret_cast<char *>(&value), 4);
+    return value;
+  }
+
+  /* reduce(): the M4 reduction of the samples [first, last] by blocks of
+   * stride samples: the index and value of the first, min, max and last
+   * sample of every block, in their original order, are appended to index
+   * and values. Every sample is read once, MAPPED_CHUNK_BYTES at most at a
+   * time, so spikes shorter than a block aren't lost between two of them.
+   * Meant for strides below MAPPED_BLOCK, where every page is needed anyway:
+   * reduceIndexed() does the larger ones.
+   */
+  bool reduce(qint64 first, qint64 last, qint64 stride,
+              std::vector<qint64> &index, std::vector<float> &values) {
+    if (first < 0 || stride <= 0 || last < first || last >= _size)
+      return false;
+
+    const qint64 perChunk =
+        stride * std::max<qint64>(1, MAPPED_CHUNK_BYTES / 4 / stride);
+    for (qint64 begin = first; begin <= last;) {
+      const qint64 n = std::min(perChunk, last + 1 - begin);
+      uchar *data = _map(begin, n);
+      if (!data)
+        return false;
+
+      const float *samples = reinterpret_cast<const float *>(data);
+      for (qint64 block = 0; block < n; block += stride) {
+        const qint64 end = std::min(n, block + stride);
+        qint64 idx[4] = {block, block, block, end - 1};
+        for (qint64 i = block + 1; i < end; i++) {
+          if (samples[i] < samples[idx[1]])
+            idx[1] = i;
+          if (samples[i] > samples[idx[2]])
+            idx[2] = i;
+        }
+
+        std::sort(idx, idx + 4);
+        for (int k = 0; k < 4; k++) {
+          if (k == 0 || idx[k] != idx[k - 1]) {
+            index.push_back(begin + idx[k]);
+            values.push_back(samples[idx[k]]);
+          }
+        }
+      }
+      _unmap(data);
+      begin += n;
+    }
+    return true;
+  }
+
+  /* reduceIndexed(): same as reduce(), from the index, for a stride that
+   * is a multiple of MAPPED_BLOCK. Blocks start at multiples of stride.
+   * Only their first and last samples are read: their bounds come from the
+   * index, and are given the index of the sample in their middle. Returns
+   * false if the array isn't indexed yet.
+   */
+  bool reduceIndexed(qint64 first, qint64 last, qint64 stride,
+                     std::vector<qint64> &index, std::vector<float> &values) {
+    if (!_indexed || first < 0 || stride <= 0 || stride % MAPPED_BLOCK ||
+        last < first || last >= _size)
+      return false;
+
+    std::vector<qint64> ends;
+    std::vector<float> extremes;
+    for (qint64 begin = first; begin <= last;) {
+      const qint64 end = std::min(last, (begin / stride + 1) * stride - 1);
+      float lo, hi;
+      if (!bounds(begin, end, lo, hi))
+        return false;
+      ends.push_back(begin);
+      ends.push_back(end);
+      extremes.push_back(lo);
+      extremes.push_back(hi);
+      begin = end + 1;
+    }
+
+    std::vector<float> samples(ends.size());
+    if (!gather(ends, samples.data()))
+      return false;
+
+    for (size_t b = 0; b < ends.size(); b += 2) {
+      const qint64 middle = (ends[b] + ends[b + 1]) / 2;
+      const qint64 idx[4] = {ends[b], middle, middle, ends[b + 1]};
+      const float value[4] = {samples[b], extremes[b], extremes[b + 1],
+                              samples[b + 1]};
+      for (int k = 0; k < 4; k++) {
+        // a block of NaNs has no bounds, and a block of 1 sample one point
+        if ((k == 1 || k == 2) && !(extremes[b] <= extremes[b + 1]))
+          continue;
+        if (k == 3 && ends[b + 1] == ends[b])
+          continue;
+        index.push_back(idx[k]);
+        values.push_back(value[k]);
+      }
+    }
+    return true;
+  }
+
+  /* gather(): copies the samples at the increasing indices index to out.
+   * The samples are mapped MAPPED_CHUNK_BYTES at most at a time, so sparse
+   * indices only bring in the pages they are on.
+   */
+  bool gather(const std::vector<qint64> &index, float *out) {
+    const qint64 perChunk = MAPPED_CHUNK_BYTES / 4;
+    for (size_t i = 0; i < index.size();) {
+      if (index[i] < 0 || index.back() >= _size)
+        return false;
+
+      size_t j = i + 1;
+      while (j < index.size() && index[j] - index[i] < perChunk)
+        j++;
+      uchar *data = _map(index[i], index[j - 1] - index[i] + 1);
+      if (!data)
+        return false;
+
+      const float *samples = reinterpret_cast<const float *>(data);
+      for (size_t k = i; k < j; k++)
+        out[k] = samples[index[k] - index[i]];
+      _unmap(data);
+      i = j;
+    }
+    return true;
+  }
+
+private:
+  explicit MappedArray(const QString &filename)
+      : _file(filename), _offset(0), _size(0), _indexed(false),
+        _sorted(false), _cancel(false) {}
+
+  /* _startIndex(): builds the index on a thread of its own. The file is
+   * read once, MAPPED_CHUNK_BYTES at a time, and the thread is stopped by
+   * the destructor if it isn't done by then.
+   */
+  void _startIndex() {
+    _indexer = std::thread([this]() {
+      const qint64 blocks = (_size + MAPPED_BLOCK - 1) / MAPPED_BLOCK;
+      std::vector<std::vector<float>> mins(1), maxs(1);
+      mins[0].resize(blocks);
+      maxs[0].resize(blocks);
+      bool sorted = true;
+      float previous = -std::numeric_limits<float>::infinity();
+
+      const qint64 perChunk = MAPPED_CHUNK_BYTES / 4;
+      for (qint64 begin = 0; begin < _size; begin += perChunk) {
+        const qint64 n = std::min(perChunk, _size - begin);
+        uchar *data = _cancel ? NULL : _map(begin, n);
+        if (!data)
+          return; // the array is never indexed
+
+        const float *samples = reinterpret_cast<const float *>(data);
+        for (qint64 i = 0; i < n; i += MAPPED_BLOCK) {
+          const qint64 end = std::min(n, i + MAPPED_BLOCK);
+          float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+          for (qint64 j = i; j < end; j++) {
+            // NaNs are skipped by the bounds, but not sorted
+            const float v = samples[j];
+            lo = (v < lo) ? v : lo;
+            hi = (v > hi) ? v : hi;
+            sorted = sorted && !(v < previous) && !std::isnan(v);
+            previous = v;
+          }
+          mins[0][(begin + i) / MAPPED_BLOCK] = lo;
+          maxs[0][(begin + i) / MAPPED_BLOCK] = hi;
+        }
+        _unmap(data);
+      }
+
+      // every level bounds LOD_FANOUT blocks of the one below
+      while (mins.back().size() > 1) {
+        const std::vector<float> &childMin = mins.back();
+        const std::vector<float> &childMax = maxs.back();
+        const size_t children = childMin.size();
+        std::vector<float> levelMin((children + LOD_FANOUT - 1) / LOD_FANOUT);
+        std::vector<float> levelMax(levelMin.size());
+        for (size_t c = 0; c < children; c++) {
+          float &lo = levelMin[c / LOD_FANOUT], &hi = levelMax[c / LOD_FANOUT];
+          lo = (c % LOD_FANOUT == 0 || childMin[c] < lo) ? childMin[c] : lo;
+          hi = (c % LOD_FANOUT == 0 || childMax[c] > hi) ? childMax[c] : hi;
+        }
+        mins.push_back(std::move(levelMin));
+        maxs.push_back(std::move(levelMax));
+      }
+
+      std::vector<std::function<void()>> listeners;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _mins = std::move(mins);
+        _maxs = std::move(maxs);
+        _sorted = sorted;
+        _indexed = true;
+        listeners.swap(_listeners);
+      }
+#if (DEBUG > 1) && (DEBUG < 3)
+      qDebug() << "MappedArray: indexed" << _file.fileName() << "sorted="
+               << sorted;
+#endif
+      for (const std::function<void()> &done : listeners)
+        done();
+    });
+  }
+
+  /* _scan(): grows lo and hi to the bounds of the samples [begin, end),
+   * read from the file.
+   */
+  bool _scan(qint64 begin, qint64 end, float &lo, float &hi) {
+    if (begin >= end)
+      return true;
+
+    uchar *data = _map(begin, end - begin);
+    if (!data)
+      return false;
+    const float *samples = reinterpret_cast<const float *>(data);
+    for (qint64 i = 0; i < end - begin; i++) {
+      lo = (samples[i] < lo) ? samples[i] : lo;
+      hi = (samples[i] > hi) ? samples[i] : hi;
+    }
+    _unmap(data);
+    return true;
+  }
+
+  bool _setLayout(qint64 offset, qint64 size) {
+    if (Q_BYTE_ORDER != Q_LITTLE_ENDIAN) {
+      qCritical() << "MappedArray!!! mapped samples must be native floats,"
+                  << "this machine is big endian.";
+      return false;
+    }
+
+    if (size <= 0 || offset + size * 4 > _file.size()) {
+      qCritical() << "MappedArray!!!" << _file.fileName()
+                  << "is too short for" << size << "samples.";
+      return false;
+    }
+
+    _offset = offset;
+    _size = size;
+    return true;
+  }
+
+  uchar *_map(qint64 first, qint64 n) {
+    // QFile keeps track of its maps, which isn't thread safe
+    std::lock_guard<std::mutex> lock(_mutex);
+    uchar *data = _file.map(_offset + first * 4, n * 4);
+    if (!data)
+      qCritical() << "MappedArray!!! can't map" << _file.fileName() << ":"
+                  << _file.errorString();
+    return data;
+  }
+
+  void _unmap(uchar *data) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _file.unmap(data);
+  }
+
+  /* _npyField(): the text of the value of key in the header of a .npy file.
+   * Quotes and parentheses are left out.
+   */
+  static QString _npyField(const QString &header, const QString &key) {
+    const int at = header.indexOf("'" + key + "'");
+    const int colon = (at < 0) ? -1 : header.indexOf(':', at);
+    if (colon < 0)
+      return QString();
+
+    const QString value = header.mid(colon + 1).trimmed();
+    const QChar open = value.size() ? value[0] : QChar();
+    if (open == '\'' || open == '(') {
+      const int close = value.indexOf(open == '(' ? ')' : '\'', 1);
+      return value.mid(1, close - 1);
+    }
+    return value.left(value.indexOf(','));
+  }
+
+  QFile _file;
+  qint64 _offset; // of the first sample in the file, in bytes
+  qint64 _size;   // in samples
+  std::mutex _mutex;
+
+  // the index, only read once _indexed is set
+  std::vector<std::vector<float>> _mins, _maxs; // level 0: MAPPED_BLOCK
+  std::atomic<bool> _indexed;
+  bool _sorted;
+  std::atomic<bool> _cancel;
+  std::vector<std::function<void()>> _listeners;
+  std::thread _indexer;
+};
+
+// series are named by their label or by their handle
+template <class T>
+struct is_series_key
+    : std::integral_constant<bool, std::is_convertible<T, QString>::value ||
+                                       std::is_same<T, SeriesHandle>::value> {
+};
+
+/* MadplotlibCloseWatcher: calls onClose when the widget it watches is
+ * closed. show() uses it to quit its event loop without having to delete the
+ * window, show_async() to tell the caller the window is gone.
+ */
+class MadplotlibCloseWatcher : public QObject {
+public:
+  MadplotlibCloseWatcher(std::function<void()> onClose)
+      : _onClose(std::move(onClose)) {}
+
+  bool eventFilter(QObject *obj, QEvent *event) override {
+    if (event->type() == QEvent::Close)
+      _onClose();
+    return QObject::eventFilter(obj, event);
+  }
+
+private:
+  std::function<void()> _onClose;
+};
+
+/* MadplotlibNavigator: zooms the x axis of the chart of a view with the
+ * wheel, around the cursor, and pans it by dragging with the middle button.
+ * It filters the events of the viewport of the view.
+ */
+class MadplotlibNavigator : public QObject {
+public:
+  explicit MadplotlibNavigator(QtCharts::QChartView *view)
+      : _view(view), _panning(false) {}
+
+  bool eventFilter(QObject *obj, QEvent *event) override {
+    QtCharts::QChart *chart = _view->chart();
+    switch (event->type()) {
+    case QEvent::Wheel: {
+      // a notch of the wheel is 120 units: it zooms in or out by 1.25
+      const QWheelEvent *wheel = static_cast<QWheelEvent *>(event);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+      const QPointF position = wheel->position();
+#else
+      const QPointF position = wheel->posF();
+#endif
+      const qreal factor = std::pow(1.25, -wheel->angleDelta().y() / 120.0);
+      const QRectF area = chart->plotArea();
+      const QPointF scene = _view->mapToScene(position.toPoint());
+      const qreal cursor =
+          qBound(area.left(), chart->mapFromScene(scene).x(), area.right());
+      chart->zoomIn(QRectF(cursor - (cursor - area.left()) * factor,
+                           area.top(), area.width() * factor, area.height()));
+      return true;
+    }
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseMove:
+    case QEvent::MouseButtonRelease: {
+      const QMouseEvent *mouse = static_cast<QMouseEvent *>(event);
+      if (event->type() == QEvent::MouseButtonPress &&
+          mouse->button() == Qt::MiddleButton)
+        _panning = true;
+      if (!_panning)
+        break;
+
+      if (event->type() == QEvent::MouseMove)
+        chart->scroll(_last.x() - mouse->pos().x(), 0);
+      if (event->type() == QEvent::MouseButtonRelease &&
+          mouse->button() == Qt::MiddleButton)
+        _panning = false;
+      _last = mouse->pos();
+      return true;
+    }
+    default:
+      break;
+    }
+    return QObject::eventFilter(obj, event);
+  }
+
+private:
+  QtCharts::QChartView *_view;
+  bool _panning;
+  QPoint _last; // position of the last event of a pan
+};
+
+class Subplots;
+
+class Madplotlib {
+  friend class Subplots;
+
+public:
+  Madplotlib(bool isWidget = false)
+      : _chart(NULL), _chartView(NULL), _scene(NULL), _isWidget(isWidget) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "Madplotlib(): isWidget=" << isWidget;
+#endif
+    _xAxisTop = _xAxisBottom = _yAxisLeft = _yAxisRight = nullptr;
+    // the chart and its view are only created by show() or render(), on the
+    // GUI thread, so plot() can be used from any thread
+
+    _redrawPending = false;
+    _alive = std::make_shared<char>(0);
+    _drainTimer = NULL;
+    _useOpenGL = false;
+    _plotAreaDirty = _plotAreaShown = false;
+    std::fill(_plotAreaRange, _plotAreaRange + 4, qreal(0));
+    _enableGrid = false;
+    _legendPos = 0;
+    _dirtyParts = AllDirty;
+    _shownRange[0] = _shownRange[1] = _shownRange[2] = _shownRange[3] = 0;
+    _xRange[0] = _xRange[1] = 0;
+    _customLimits = false;
+    _width = DEFAULT_WIDTH;
+    _height = DEFAULT_HEIGHT;
+    _xMin = _xMax = _yMin = _yMax = 0;
+
+    _showXticks = _showYticks = SHOW_TICK;
+    _xTickCount = 7;
+    _yTickCount = 5;
+
+    _colorIdx = 0;
+    _colors.push_back(QColor(0x1f77b4));
+    _colors.push_back(QColor(0xff7f0e));
+    _colors.push_back(QColor(0x2ca02c));
+    _colors.push_back(QColor(0xd62728));
+    _colors.push_back(QColor(0x9467bd));
+    _colors.push_back(QColor(0x8c564b));
+    _colors.push_back(QColor(0xe377c2));
+    _colors.push_back(QColor(0x7f7f7f));
+    _colors.push_back(QColor(0xbcbd22));
+    _colors.push_back(QColor(0x17becf));
+  }
+
+  ~Madplotlib() {
+    // the Qt objects of a window opened by show_async() belong to the GUI
+    // thread, so they are destroyed there, after any pending redraw
+    if (_window) {
+      _runOnGuiAndWait([this]() {
+        _alive.reset();
+        _destroyChart();
+        for (SeriesData &data : _seriesVec)
+          data.series.reset();
+        _retiredSeries.clear();
+      });
+      _window->close();
+      return;
+    }
+
+    _destroyChart();
+  }
+
+  Madplotlib(const Madplotlib &) = delete;
+  Madplotlib &operator=(const Madplotlib &) = delete;
+
+  void axis(QString cmd) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "axis(): cmd=" << cmd;
+#endif
+    FigureEdit edit(this);
+    if (cmd == "off") {
+      _showYticks = _showXticks = HIDE_TICK;
+      _dirtyParts |= XAxisDirty | YAxisDirty;
+    } else if (cmd == "xoff") {
+      _showXticks = HIDE_TICK;
+      _dirtyParts |= XAxisDirty;
+    } else if (cmd == "yoff") {
+      _showYticks = HIDE_TICK;
+      _dirtyParts |= YAxisDirty;
+    } else {
+      qCritical() << "axis()!!! options are 'off', 'xoff' and 'yoff'.";
+      return;
+    }
+  }
+
+  /* axis(): gets the current axes limits [xMin, xMax, yMin, yMax].
+   */
+  void axis(qreal *xMin, qreal *xMax, qreal *yMin, qreal *yMax) {
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    _autoscale();
+
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "axis(): _xMin=" << _xMin << " _xMax=" << _xMax
+             << " _yMin=" << _yMin << " _yMax=" << _yMax;
+#endif
+    *xMin = _xMin;
+    *xMax = _xMax;
+    *yMin = _yMin;
+    *yMax = _yMax;
+  }
+
+  /* axis(): sets the viewport of the axis by a list of [xMin, xMax, yMin,
+   * yMax].
+   */
+  void axis(const qreal &xMin, qreal xMax, const qreal &yMin,
+            const qreal &yMax) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "axis(): xMin=" << xMin << " xMax=" << xMax << " yMin=" << yMin
+             << " yMax=" << yMax;
+#endif
+    FigureEdit edit(this);
+    _xMin = xMin;
+    _xMax = xMax;
+    _yMin = yMin;
+    _yMax = yMax;
+    _customLimits = true;
+  }
+
+  /* xlim(): sets the x limits of the current axes.
+   */
+  void xlim(const qreal &xMin, const qreal &xMax) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "xlim(): xMin=" << xMin << " xMax=" << xMax;
+#endif
+    FigureEdit edit(this);
+    _autoscale(); // the other axis keeps the range of the data so far
+    _xMin = xMin;
+    _xMax = xMax;
+    _customLimits = true;
+  }
+
+  /* ylim(): sets the x limits of the current axes.
+   */
+  void ylim(const qreal &yMin, const qreal &yMax) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "ylim(): yMin=" << yMin << " yMax=" << yMax;
+#endif
+    FigureEdit edit(this);
+    _autoscale(); // the other axis keeps the range of the data so far
+    _yMin = yMin;
+    _yMax = yMax;
+    _customLimits = true;
+  }
+
+  /* title(): defines the title of the chart.
+   */
+  void title(QString string) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "title(): string=" << string;
+#endif
+    FigureEdit edit(this);
+    _title = string;
+    _dirtyParts |= TitleDirty;
+  }
+
+  /* xlabel(): defines the label displayed below the x axis.
+   */
+  void xlabel(QString label) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "xlabel(): label=" << label;
+#endif
+    FigureEdit edit(this);
+    _xLabel = label;
+    _dirtyParts |= XAxisDirty;
+  }
+
+  /* ylabel(): defines the label displayed to the left of the y axis.
+   */
+  void ylabel(QString label) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "ylabel(): label=" << label;
+#endif
+    FigureEdit edit(this);
+    _yLabel = label;
+    _dirtyParts |= YAxisDirty;
+  }
+
+  /* legend(): defines the position of the legend label inside the chart.
+   */
+  void legend() {
+    FigureEdit edit(this);
+    _legendPos = Qt::AlignBottom;
+    _dirtyParts |= LegendDirty;
+  }
+
+  /* legend(): defines the position of the legend label inside the chart.
+   * An invalid position leaves the legend where it was.
+   */
+  void legend(QString cmd) {
+    FigureEdit edit(this);
+    const int pos = _parseLegendPos(cmd);
+    if (!pos)
+      return;
+
+    _legendPos = pos;
+    _dirtyParts |= LegendDirty;
+  }
+
+  /* grid(): enables or disables the background grid of the chart.
+   */
+  void grid(bool status) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "grid(): status=" << status;
+#endif
+    FigureEdit edit(this);
+    _enableGrid = status;
+    _dirtyParts |= XAxisDirty | YAxisDirty;
+  }
+
+  /* opengl(): draws the series of the window with OpenGL. It's off by
+   * default: without a GPU, software OpenGL is slower than the raster
+   * engine. Big scatter plots are better drawn with density="on".
+   */
+  void opengl(bool enable) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "opengl(): enable=" << enable;
+#endif
+    FigureEdit edit(this);
+    _useOpenGL = enable;
+    if (_chartView && !_window)
+      _setUseOpenGL(enable);
+  }
+
+  /* savefig(): saves the chart as an image on the disk.
+   * The chart is rendered offscreen so show() doesn't need to be called
+   * first: no window is created and no event loop is run.
+   * The format comes from the extension of filename. ".svg" and ".pdf" give
+   * vector documents, any other extension supported by QImage a raster one.
+   * width, height: size of the image in pixels, 0 means the size of show().
+   * dpi: resolution of the image. Fonts, pens and markers are scaled by
+   *      dpi/96, so a higher dpi gives a sharper image of the same chart.
+   */
+  void savefig(const QString &filename, int width = 0, int height = 0,
+               int dpi = DEFAULT_DPI) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "savefig(): filename=" << filename << " width=" << width
+             << " height=" << height << " dpi=" << dpi;
+#endif
+    const QString suffix = QFileInfo(filename).suffix().toLower();
+    if (suffix == "svg" || suffix == "pdf") {
+      _saveVector(filename, suffix, width, height, dpi);
+      return;
+    }
+
+    QImage image = render(width, height, dpi);
+    if (image.isNull())
+      return;
+
+    if (!image.save(filename))
+      qCritical() << "savefig()!!! failed to write" << filename;
+  }
+
+  /* render(): draws the chart on an image, without any window.
+   * The arguments have the same meaning as in savefig().
+   */
+  QImage render(int width = 0, int height = 0, int dpi = DEFAULT_DPI) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "render(): width=" << width << " height=" << height
+             << " dpi=" << dpi;
+#endif
+    QSizeF oldSize;
+    if (!_beginOffscreen(width, height, dpi, oldSize))
+      return QImage();
+
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    const int dotsPerMeter = qRound(dpi / 0.0254);
+    image.setDotsPerMeterX(dotsPerMeter);
+    image.setDotsPerMeterY(dotsPerMeter);
+    image.fill(Qt::white);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    _paintOffscreen(&painter, width, height);
+    painter.end();
+
+    _endOffscreen(oldSize);
+    return image;
+  }
+
+  /* Figure: describes a figure for renderBatch() by calling plot(), title(),
+   * legend() and friends on the object it receives. It runs on a worker
+   * thread, so it must not call show(), render() or savefig().
+   */
+  typedef std::function<void(Madplotlib &)> Figure;
+
+  /* BatchResult: the outcome of one figure of renderBatch().
+   */
+  struct BatchResult {
+    QImage image;     // the figure, unless it was written to a file
+    bool saved;       // true if the figure was written to its file
+    qint64 prepareNs; // time spent describing the figure, on a worker
+    qint64 renderNs;  // time spent painting the figure, on the GUI thread
+    qint64 encodeNs;  // time spent writing the file, on a worker
+
+    BatchResult() : saved(false), prepareNs(0), renderNs(0), encodeNs(0) {}
+  };
+
+  /* renderBatch(): renders many figures into images, using every core.
+   * Qt only allows charts to be created and painted on the GUI thread, so
+   * the work is pipelined: worker threads run the Figure callbacks (which
+   * is where data gets converted, decimated and measured) and encode the
+   * image files, while the calling thread, which must be the GUI thread,
+   * paints the figures as soon as they are ready.
+   * filenames: where each figure is saved. When empty, the images are kept
+   *            in the results instead.
+   * width, height, dpi: same as savefig().
+   * threads: number of worker threads, 0 picks one per spare core.
+   */
+  static QVector<BatchResult>
+  renderBatch(const QVector<Figure> &figures,
+              const QStringList &filenames = QStringList(), int width = 0,
+              int height = 0, int dpi = DEFAULT_DPI, int threads = 0) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "renderBatch(): figures=" << figures.size()
+             << " threads=" << threads;
+#endif
+    const int n = figures.size();
+    QVector<BatchResult> results(n);
+    BatchResult *out = results.data(); // shared by threads, never detached
+
+    if (!filenames.isEmpty() && filenames.size() != n) {
+      qCritical() << "renderBatch()!!! the amount of figures and filenames "
+                     "must match!";
+      return results;
+    }
+
+    if (!QCoreApplication::instance() ||
+        QThread::currentThread() != QCoreApplication::instance()->thread()) {
+      qCritical() << "renderBatch()!!! must be called from the GUI thread.";
+      return results;
+    }
+
+    if (threads <= 0)
+      threads = std::max(1, QThread::idealThreadCount() - 1);
+
+    // figures described by workers wait here for the GUI thread, and figures
+    // painted by the GUI thread wait here to be encoded by workers
+    std::mutex mutex;
+    std::condition_variable guiWait, workerWait;
+    std::deque<std::pair<int, Madplotlib *>> prepared;
+    std::deque<int> encode;
+    const size_t maxPrepared = 2 * threads; // bounds the memory in flight
+    int next = 0;      // next figure to be described
+    bool done = false; // every figure went through the GUI thread
+
+    auto worker = [&]() {
+      for (;;) {
+        int toEncode = -1, toPrepare = -1;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          workerWait.wait(lock, [&]() {
+            return !encode.empty() || done ||
+                   (next < n && prepared.size() < maxPrepared);
+          });
+
+          if (!encode.empty()) {
+            toEncode = encode.front();
+            encode.pop_front();
+          } else if (next < n && prepared.size() < maxPrepared) {
+            toPrepare = next++;
+          } else {
+            return; // done, and nothing left to encode
+          }
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if (toEncode >= 0) {
+          BatchResult &result = out[toEncode];
+          result.saved = result.image.save(filenames[toEncode]);
+          if (!result.saved)
+            qCritical() << "renderBatch()!!! failed to write"
+                        << filenames[toEncode];
+          result.image = QImage();
+          result.encodeNs = timer.nsecsElapsed();
+          continue;
+        }
+
+        std::unique_ptr<Madplotlib> plt(new Madplotlib());
+        figures[toPrepare](*plt);
+        out[toPrepare].prepareNs = timer.nsecsElapsed();
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          prepared.push_back(std::make_pair(toPrepare, plt.release()));
+        }
+        guiWait.notify_one();
+      }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < threads; i++)
+      pool.emplace_back(worker);
+
+    for (int i = 0; i < n; i++) {
+      std::pair<int, Madplotlib *> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        guiWait.wait(lock, [&]() { return !prepared.empty(); });
+        job = prepared.front();
+        prepared.pop_front();
+      }
+      workerWait.notify_one(); // there's room for another figure
+
+      QElapsedTimer timer;
+      timer.start();
+      std::unique_ptr<Madplotlib> plt(job.second);
+      QImage image = plt->render(width, height, dpi);
+      plt.reset(); // Qt objects must also be destroyed on the GUI thread
+
+      BatchResult &result = out[job.first];
+      result.image = image;
+      result.renderNs = timer.nsecsElapsed();
+
+      if (!filenames.isEmpty() && !image.isNull()) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          encode.push_back(job.first);
+        }
+        workerWait.notify_one();
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+    }
+    workerWait.notify_all();
+
+    for (std::thread &t : pool)
+      t.join();
+
+    return results;
+  }
+
+  /* subplots(): a grid of rows x cols charts, drawn as a single figure.
+   * sharex, sharey: every chart gets the same x/y range and ticks.
+   * See Subplots.
+   */
+  static std::unique_ptr<Subplots> subplots(int rows, int cols,
+                                            bool sharex = false,
+                                            bool sharey = false);
+
+  /* xticks(): sets the x-limits of the current tick locations and labels.
+   */
+  void xticks(const Eigen::ArrayXf &values, const QVector<QString> &labels) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "xticks(): values.sz=" << values.rows()
+             << " labels.sz=" << labels.size();
+#endif
+    FigureEdit edit(this);
+    _dirtyParts |= XAxisDirty;
+    if (values.rows() == 0 && labels.size() == 0) {
+      _showXticks = HIDE_TICK;
+      return;
+    }
+
+    if (values.rows() != labels.size()) {
+      qCritical() << "xticks(): the amount of values and labels must match!";
+      return;
+    }
+
+    for (int i = 0; i < values.rows(); i++)
+      _xTicks.push_back(QPair<QString, qreal>(labels[i], values[i]));
+
+    _showXticks = SHOW_CUSTOM_TICK;
+
+#if (DEBUG > 1) && (DEBUG < 3)
+    qDebug() << "xticks(): xticks.sz=" << _xTicks.size();
+    for (int i = 0; i < _xTicks.size(); i++)
+      qDebug() << "\t" << _xTicks[i].second << " = " << _xTicks[i].first;
+#endif
+  }
+
+  /* yticks(): sets the y-limits of the current tick locations and labels.
+   */
+  void yticks(const Eigen::ArrayXf &values, const QVector<QString> &labels) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "yticks(): values.sz=" << values.rows()
+             << " labels.sz=" << labels.size();
+#endif
+    FigureEdit edit(this);
+    _dirtyParts |= YAxisDirty;
+    if (values.rows() == 0 && labels.size() == 0) {
+      _showYticks = HIDE_TICK;
+      return;
+    }
+
+    if (values.rows() != labels.size()) {
+      qCritical()
+          << "PlotLib::xticks(): the amount of values and labels must match!";
+      return;
+    }
+
+    for (int i = 0; i < values.rows(); i++)
+      _yTicks.push_back(QPair<QString, qreal>(labels[i], values[i]));
+
+    _showYticks = SHOW_CUSTOM_TICK;
+
+#if (DEBUG > 1) && (DEBUG < 3)
+    qDebug() << "yticks(): yticks.sz=" << _yTicks.size();
+    for (int i = 0; i < _yTicks.size(); i++)
+      qDebug() << "\t" << _yTicks[i].second << " = " << _yTicks[i].first;
+#endif
+  }
+
+  /* locator_params(): reduce or increase the amount of ticks for each axis.
+   */
+  void locator_params(QString axis, int nbins) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "locator_params(): axis=" << axis << " nbins=" << nbins;
+#endif
+    FigureEdit edit(this);
+    if (axis == "x") {
+      _xTickCount = nbins;
+      _dirtyParts |= XAxisDirty;
+    } else if (axis == "y") {
+      _yTickCount = nbins;
+      _dirtyParts |= YAxisDirty;
+    } else if (axis == "both") {
+      _yTickCount = _xTickCount = nbins;
+      _dirtyParts |= XAxisDirty | YAxisDirty;
+    } else {
+      qCritical() << "locator_params(): '" << axis
+                  << "' is not a valid option.";
+      return;
+    }
+  }
+
+  template <class Y, class T, class... Args>
+  typename std::enable_if<is_plot_data<Y>::value && !is_plot_data<T>::value,
+                          SeriesHandle>::type
+  plot(const Y &yIn, const T &arg1, const Args &...args) {
+    FigureEdit edit(this);
+    const auto &y = _samples(yIn);
+
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "plot(y): marker=" << marker << " alpha=" << alpha
+             << " color=" << color << " edgecolor=" << edgecolor
+             << " linewidth=" << linewidth << " markersize=" << markersize;
+#endif
+    if (y.rows() == 0) {
+      qCritical() << "plot(y): axis size must be > 0 but its " << y.rows();
+      exit(-1);
+    }
+
+    // number of x values needed to accompany the y values
+    int num_items = y.rows();
+
+    // make up X data, but take into account that xlim() could have been
+    // called with the start and end of x series.
+    qreal x_value = _customLimits ? _xMin : 0;
+    qreal x_inc = 1;
+    if (_customLimits && (_xMin != _xMax)) {
+      qreal xrange = _xMax - _xMin;
+      x_inc = xrange / y.rows();
+    }
+
+#if (DEBUG > 1) && (DEBUG < 3)
+    qDebug() << "plot(y): generated x from" << x_value << "by" << x_inc;
+#endif
+
+    // x is never stored: it is computed as x_value + x_inc * i whenever it is
+    // needed, so it doesn't drift like a running sum of x_inc would
+    return _plotSeries(
+        Eigen::ArrayXd::LinSpaced(num_items, x_value,
+                                  x_value + x_inc * (num_items - 1)),
+        y, x_inc, arg1, args...);
+  }
+
+  /* plot(): called when user needs to put data on a chart.
+   * x: an array that stores x axis values.
+   * y: an array that stores y axis values.
+   * marker: chart types. "-" for line plot and "o" for scatter plot.
+   * alpha: defines the transparency level of the color.
+   * color: defines the color used to draw the data.
+   * edgecolor: defines the edge color of "o" marker.
+   * linewidth: defines the width of the pen used to draw "-" marker.
+   * markersize: defines the size of "o" marker.
+   * decimate: "none", "m4", "lttb" or "lod". Reduces line series to about 4
+   *           points per horizontal pixel of the chart before handing them
+   *           to Qt. "lod" keeps a min/max index of the samples, so zooming
+   *           and panning only query the visible range, in O(pixels log n).
+   *           Its x must be increasing.
+   * capacity: max number of points kept by the series. Only the last
+   *           capacity points are displayed and append() drops the oldest
+   *           ones when new samples arrive. 0 means unbounded.
+   * density: "auto", "on" or "off". Scatter plots drawn as a density image
+   *          count the points falling on every pixel instead of painting a
+   *          marker per point, so they take the same time to draw whatever
+   *          the number of points. "auto" does it from
+   *          DEFAULT_DENSITY_POINTS points on.
+   *
+   * x and y may also be an Eigen::Map over memory owned by the caller, in
+   * which case the data is read in place and never copied into an ArrayXf.
+   * They may be any Eigen expression as well, like x.sqrt() - noise, which
+   * is evaluated straight into the points of the series.
+   * Besides float, the samples may be double or integers (ArrayXd, ArrayXi,
+   * Array<int16_t, Dynamic, 1>...), or come from a std::vector or a QVector
+   * of numbers. They are converted while being written into the points.
+   *
+   * Returns the handle of the series, which update(), remove() and the
+   * style setters use to reach it in O(1). Plotting again with the label of
+   * an existing series replaces it, and returns the same handle. Series
+   * without a label are always new ones.
+   */
+  template <class X, class Y, class... Args>
+  typename std::enable_if<is_plot_data<X>::value && is_plot_data<Y>::value,
+                          SeriesHandle>::type
+  plot(const X &x, const Y &y, const Args &...args) {
+    return plotXY(_samples(x), _samples(y), args...);
+  }
+
+  /* plot(): same as above, but reads n values straight from the x and y
+   * buffers. Nothing is copied until the points are handed to Qt Charts.
+   */
+  template <class Tx, class Ty, class... Args>
+  typename std::enable_if<is_sample_scalar<Tx>::value &&
+                              is_sample_scalar<Ty>::value,
+                          SeriesHandle>::type
+  plot(const Tx *x, const Ty *y, int n, const Args &...args) {
+    if (!x || !y || n <= 0) {
+      qCritical() << "plot(x,y,n): invalid buffers or size n=" << n;
+      exit(-1);
+    }
+
+    return plotXY(Eigen::Map<const Eigen::Array<Tx, Eigen::Dynamic, 1>>(x, n),
+                  Eigen::Map<const Eigen::Array<Ty, Eigen::Dynamic, 1>>(y, n),
+                  args...);
+  }
+
+  template <class X, class Y, class... Args>
+  typename std::enable_if<
+      is_plot_data<X>::value && is_plot_data<Y>::value &&
+      !(is_matrix_expression<X>::value && is_matrix_expression<Y>::value),
+      SeriesHandle>::type
+  plotXY(const X &x, const Y &y, const Args &...args) {
+    return plotXY(_samples(x), _samples(y), args...);
+  }
+
+  template <class Dx, class Dy, class... Args>
+  SeriesHandle plotXY(const Eigen::DenseBase<Dx> &x,
+                      const Eigen::DenseBase<Dy> &y, const Args &...args) {
+    // x sampled at a fixed step, from ArrayXd::LinSpaced(), is never stored
+    qreal dx = std::numeric_limits<qreal>::quiet_NaN();
+    if (std::is_same<Dx, UniformX>::value && x.size() > 1)
+      dx = (x.derived().coeff(x.size() - 1) - x.derived().coeff(0)) /
+           (x.size() - 1);
+
+    return _plotSeries(x.derived(), y.derived(), dx, args...);
+  }
+
+  /* plot(): plots the samples of a file mapped by MappedArray, against
+   * their index. The file is never loaded: the samples within the x range
+   * shown by the chart are reduced to the first, min, max and last sample
+   * of DEFAULT_MAPPED_POINTS blocks, so that spikes survive the reduction.
+   * The bounds of blocks of MAPPED_BLOCK samples or more come from the index
+   * of the array, so a view reads a few pages per block rather than every
+   * sample; smaller blocks are read in full. Until the array is indexed,
+   * the chart shows one sample per block, and is redrawn once it is.
+   * The window is cut again when the range moves, and its pages are
+   * unmapped as soon as the points are made. The x limits don't grow to fit
+   * the window, since it's cut to them.
+   */
+  template <class... Args>
+  SeriesHandle plot(const std::shared_ptr<MappedArray> &y,
+                    const Args &...args) {
+    return plot(std::shared_ptr<MappedArray>(), y, args...);
+  }
+
+  /* plot(): same as above, with x read from a mapped file too. x must be
+   * sorted, without NaNs: the window is found by binary search. This is
+   * checked while x is indexed, and the series is rejected if it isn't, or
+   * stops following the range if that's found out after it was plotted.
+   */
+  template <class... Args>
+  SeriesHandle plot(const std::shared_ptr<MappedArray> &x,
+                    const std::shared_ptr<MappedArray> &y,
+                    const Args &...args) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "plot(mapped): sz=" << (y ? y->size() : 0);
+#endif
+    if (!y || (x && x->size() != y->size())) {
+      qCritical() << "plot(mapped): x and y must be mapped arrays of the same "
+                     "size.";
+      return SeriesHandle();
+    }
+
+    if (x && x->indexed() && !x->isSorted()) {
+      qCritical() << "plot(mapped): x must be sorted and can't hold NaNs.";
+      return SeriesHandle();
+    }
+
+    FigureEdit edit(this);
+    std::shared_ptr<MappedSeries> mapped(new MappedSeries);
+    mapped->x = x;
+    mapped->y = y;
+
+    Eigen::ArrayXd xs;
+    Eigen::ArrayXf ys;
+    if (!_cutWindow(*mapped, xs, ys))
+      return SeriesHandle();
+
+    const qreal xMin = _xMin, xMax = _xMax;
+    const SeriesHandle handle =
+        xs.rows() ? _plotSeries(xs, ys, std::numeric_limits<qreal>::quiet_NaN(),
+                                args...)
+                  : _plotSeries(_mappedIndex(*mapped), ys, 1, args...);
+    _xMin = xMin;
+    _xMax = xMax;
+
+    SeriesData *data = _findSeries(handle);
+    if (data) {
+      data->mapped = mapped;
+      _mappedBounds(*data);
+    }
+    return handle;
+  }
+
+  /* hist2d(): plots the 2D histogram of the points (x, y): bins x bins
+   * rectangles spanning the bounds of the points, colored by the colormap
+   * cmap ("viridis", "plasma", "hot" or "gray") from the emptiest bin to the
+   * fullest. The points are binned in parallel.
+   * The histogram is drawn as an image under the series, on the same axes,
+   * so xlim(), ylim() and axis() crop it like any series.
+   */
+  void hist2d(const Eigen::ArrayXf &x, const Eigen::ArrayXf &y,
+              int bins = DEFAULT_HIST2D_BINS,
+              const QString &cmap = DEFAULT_CMAP) {
+    _histogram2D(x, y, bins, cmap, false);
+  }
+
+  /* hexbin(): same as hist2d(), with hexagonal bins: gridsize hexagons
+   * across the x range, and as many along y as it takes for them to be
+   * regular.
+   */
+  void hexbin(const Eigen::ArrayXf &x, const Eigen::ArrayXf &y,
+              int gridsize = DEFAULT_GRIDSIZE,
+              const QString &cmap = DEFAULT_CMAP) {
+    _histogram2D(x, y, gridsize, cmap, true);
+  }
+
+  /* imshow(): shows z as an image, under the series, each value colored by
+   * the colormap cmap from vmin to vmax. NaN values are transparent.
+   * vmin, vmax: the bounds of z when they are NaN.
+   * Value (r, c) is a pixel over [c - 0.5, c + 0.5] x [r - 0.5, r + 0.5] on
+   * the axes of the chart, so row 0 is at the bottom, like origin="lower"
+   * in matplotlib.
+   * z is any 2D float Eigen array or expression. Arrays and blocks of them
+   * are read in place. Row major arrays are the fastest to show, since
+   * their rows are the scanlines of the image; the columns of an ArrayXXf
+   * have to be turned into rows first, a tile at a time.
+   */
+  template <class Derived>
+  void imshow(const Eigen::DenseBase<Derived> &z,
+              const QString &cmap = DEFAULT_CMAP,
+              qreal vmin = std::numeric_limits<qreal>::quiet_NaN(),
+              qreal vmax = std::numeric_limits<qreal>::quiet_NaN()) {
+    typedef Eigen::Array<float, Eigen::Dynamic, Eigen::Dynamic,
+                         Derived::IsRowMajor ? Eigen::RowMajor
+                                             : Eigen::ColMajor>
+        Plain;
+    const Eigen::Ref<const Plain> values(z.derived());
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "imshow(): " << values.rows() << "x" << values.cols()
+             << " cmap=" << cmap << " vmin=" << vmin << " vmax=" << vmax;
+#endif
+    if (!values.size()) {
+      qCritical() << "imshow()!!! z is empty.";
+      return;
+    }
+
+    ImageData image;
+    image.colormap = _colormap(cmap);
+    if (image.colormap.isEmpty()) {
+      qCritical() << "imshow()!!! unknown colormap" << cmap;
+      return;
+    }
+
+    if (std::isnan(vmin) || std::isnan(vmax)) {
+      qreal zMin = std::numeric_limits<qreal>::infinity(), zMax = -zMin;
+      for (int o = 0; o < values.outerSize(); o++) {
+        qreal oMin, oMax;
+        _minMax<float>(Eigen::Map<const Eigen::ArrayXf>(
+                           values.data() + qint64(o) * values.outerStride(),
+                           values.innerSize()),
+                       oMin, oMax);
+        zMin = std::min(zMin, oMin);
+        zMax = std::max(zMax, oMax);
+      }
+      vmin = std::isnan(vmin) ? zMin : vmin;
+      vmax = std::isnan(vmax) ? zMax : vmax;
+    }
+
+    const int rows = values.rows(), cols = values.cols();
+    image.image = QImage(cols, rows, QImage::Format_ARGB32_Premultiplied);
+    if (image.image.isNull()) {
+      qCritical() << "imshow()!!! can't allocate an image of" << cols << "x"
+                  << rows << "pixels.";
+      return;
+    }
+
+    image.colormap.append(qRgba(0, 0, 0, 0)); // NaN
+    _applyColormap(image.image, values.data(), rows, cols,
+                   values.outerStride(), Derived::IsRowMajor, image.colormap,
+                   vmin, vmax);
+    image.nx = cols;
+    image.ny = rows;
+    image.extent[0] = -0.5;
+    image.extent[1] = cols - 0.5;
+    image.extent[2] = -0.5;
+    image.extent[3] = rows - 0.5;
+
+    FigureEdit edit(this);
+    _images.append(image);
+    _plotAreaDirty = true;
+  }
+
+  /* hist(): plots the histogram of the samples of x, in bins=n bins of the
+   * same width (DEFAULT_HIST_BINS by default) over range=qMakePair(xMin,
+   * xMax), or the bounds of x where they are NaN, as they are by default.
+   * Samples out of the range, or NaN, aren't counted. The last bin also
+   * holds xMax.
+   * The samples are binned by several threads, a bin being found with a
+   * single product. The bars are outlined by one line series, so they are
+   * drawn as a single path. The other args are the keywords of plot():
+   * label, color...
+   * Returns the handle of the series, for hist(handle, x) to count more
+   * samples.
+   */
+  template <class... Args>
+  SeriesHandle hist(const Eigen::ArrayXf &x, const Args &...args) {
+    const PlotOptions options = PlotOptions::from(args...);
+    const int count = options.bins;
+    qreal xMin = options.range.first, xMax = options.range.second;
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "hist(): sz=" << x.rows() << " bins=" << count
+             << " range=" << xMin << xMax;
+#endif
+    if (count <= 0) {
+      qCritical() << "hist()!!! bins must be > 0 but it is" << count;
+      return SeriesHandle();
+    }
+
+    if (std::isnan(xMin) || std::isnan(xMax)) {
+      qreal lo, hi;
+      _minMax<float>(x, lo, hi);
+      if (lo > hi) // no samples
+        lo = 0, hi = 1;
+      xMin = std::isnan(xMin) ? lo : xMin;
+      xMax = std::isnan(xMax) ? hi : xMax;
+    }
+
+    // like numpy, an empty range is widened to give the bins some width
+    if (xMin == xMax)
+      xMin -= 0.5, xMax += 0.5;
+
+    QVector<qreal> edges(count + 1);
+    for (int i = 0; i <= count; i++)
+      edges[i] = xMin + (xMax - xMin) * i / count;
+    return _hist(x, edges, args...);
+  }
+
+  /* hist(): same as above, with the edges of the bins given, in increasing
+   * order, in place of bins and range. A bin is found by a binary search,
+   * unless the edges turn out to be evenly spaced.
+   */
+  template <class... Args>
+  SeriesHandle hist(const Eigen::ArrayXf &x, const Eigen::ArrayXd &edges,
+                    const Args &...args) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "hist(): sz=" << x.rows() << " edges=" << edges.rows();
+#endif
+    if (edges.rows() < 2 ||
+        !(edges.tail(edges.rows() - 1) > edges.head(edges.rows() - 1)).all()) {
+      qCritical() << "hist()!!! there must be 2 or more edges, in increasing "
+                     "order.";
+      return SeriesHandle();
+    }
+
+    QVector<qreal> bins(edges.rows());
+    std::copy(edges.data(), edges.data() + edges.rows(), bins.begin());
+    return _hist(x, bins, args...);
+  }
+
+  /* hist(): adds the samples of x to the histogram of handle, made by
+   * hist(). Only the new samples are binned, into the bins of the
+   * histogram, so a histogram can grow by millions of samples at a time
+   * without going over the older ones again.
+   */
+  void hist(const SeriesHandle &handle, const Eigen::ArrayXf &x) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "hist(handle): sz=" << x.rows();
+#endif
+    std::shared_ptr<HistogramBins> bins;
+    {
+      std::lock_guard<std::recursive_mutex> lock(_mutex);
+      SeriesData *data = _findSeries(handle);
+      if (!data)
+        return;
+
+      bins = data->histogram;
+      if (!bins) {
+        qCritical() << "hist(handle): the series" << data->name
+                    << "isn't a histogram.";
+        return;
+      }
+    }
+
+    // the edges never change, so the figure isn't held while binning
+    std::vector<quint32> counts;
+    _binSamples(*bins, x, counts);
+
+    FigureEdit edit(this);
+    SeriesData *data = _findSeries(handle);
+    if (!data || data->histogram != bins) // replaced meanwhile
+      return;
+
+    for (int i = 0; i < int(bins->counts.size()); i++)
+      bins->counts[i] += counts[i];
+    _storeHistogram(*data);
+  }
+
+  /* append(): pushes new samples at the end of the series created by plot()
+   * with the given label, or of the series of a handle. If that series has a
+   * capacity, the oldest samples are dropped in O(1) so it never holds more
+   * than capacity points.
+   * Storing the samples costs in proportion to their number, and so do the
+   * points of an unbounded series, which are extended in place. A series
+   * with a capacity lays out its capacity points again, and a decimated one
+   * is decimated again from all of its samples, when it is refreshed. The
+   * Qt series is refreshed with a single bulk replace() of all of its points
+   * when the chart is on screen, or deferred to show() otherwise, so feed it
+   * blocks of samples rather than one sample at a time.
+   */
+  template <class Key, class X, class Y>
+  typename std::enable_if<is_series_key<Key>::value && is_plot_data<X>::value &&
+                          is_plot_data<Y>::value>::type
+  append(const Key &target, const X &xIn, const Y &yIn) {
+    FigureEdit edit(this);
+    // stored data is read in place, anything else is evaluated once
+    const auto &xa = _asArray(_samples(xIn));
+    const auto &ya = _asArray(_samples(yIn));
+    const SampleRef<typename std::decay<decltype(xa)>::type::Scalar> x = xa;
+    const SampleRef<typename std::decay<decltype(ya)>::type::Scalar> y = ya;
+
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "append(): sz=" << x.rows();
+#endif
+    if (x.rows() != y.rows()) {
+      qCritical() << "append(): x.sz=" << x.rows() << " != y.sz=" << y.rows();
+      exit(-1);
+    }
+
+    SeriesData *data = _appendTarget(_findSeries(target, "append()"), x.rows());
+    if (!data)
+      return;
+
+    _appendSamples(*data, x, y);
+    _refresh(*data);
+  }
+
+  /* append(): same as above, for series created by plot(y) or whose x is
+   * sampled at a fixed step. x goes on at the same step, so only y is given.
+   */
+  template <class Key, class Y>
+  typename std::enable_if<is_series_key<Key>::value &&
+                          is_plot_data<Y>::value>::type
+  append(const Key &target, const Y &yIn) {
+    FigureEdit edit(this);
+    const auto &ya = _asArray(_samples(yIn));
+    const SampleRef<typename std::decay<decltype(ya)>::type::Scalar> y = ya;
+
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "append(): sz=" << y.rows();
+#endif
+    SeriesData *data = _appendTarget(_findSeries(target, "append()"), y.rows());
+    if (!data)
+      return;
+
+    if (!data->uniform) {
+      qCritical() << "append(): the series" << data->name
+                  << "needs x values.";
+      return;
+    }
+
+    _appendSamples(*data, y);
+    _refresh(*data);
+  }
+
+  /* ingest(): the queue other threads feed the series of handle through.
+   * Any number of producer threads may push() samples to it at the same
+   * time, without ever taking a lock or waiting for the figure. While the
+   * chart is on screen, a timer of the GUI thread drains the queues of every
+   * series once per frame, appending all the samples that piled up in one
+   * bulk update; render() and savefig() drain them too.
+   * Samples pushed while the queue is full are dropped and counted, see
+   * SampleQueue::stats(). x is ignored for series sampled at a fixed step,
+   * and required by the others: samples pushed without it are dropped.
+   * capacity: max number of samples waiting in the queue, rounded up to a
+   *           power of 2. Only used the first time, when the queue is made.
+   */
+  std::shared_ptr<SampleQueue>
+  ingest(const SeriesHandle &handle, int capacity = DEFAULT_INGEST_CAPACITY) {
+    FigureEdit edit(this);
+    SeriesData *data = _findSeries(handle);
+    if (!data)
+      return std::shared_ptr<SampleQueue>();
+
+    if (!data->inbox) {
+      data->inbox.reset(new SampleQueue(capacity, data->uniform));
+      // a widget on screen drains it from now on, through its GUI thread as
+      // ingest() may be called from any thread; a window of show_async()
+      // once the redraw of this edit gets to it
+      if (!_window && _chartView) {
+        const std::weak_ptr<char> alive = _alive;
+        _runOnGui([this, alive]() {
+          if (alive.expired())
+            return;
+
+          std::lock_guard<std::recursive_mutex> lock(_mutex);
+          _startDrainTimer();
+        });
+      }
+    }
+    return data->inbox;
+  }
+
+  /* show(): displays all the data added through plot() calls.
+   */
+  void show() {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "show(): " << _title;
+#endif
+    if (!_buildChart())
+      return;
+
+    if (!_chartView)
+      _createView();
+    _startDrainTimer();
+
+    _setUseOpenGL(_useOpenGL);
+    _chartView->setRenderHint(QPainter::Antialiasing);
+    _chartView->resize(_width, _height);
+    _chartView->show();
+
+    // This loop blocks execution & waits for the window to be closed.
+    // However, is this chart is supposed to be a real widget, then do none of
+    // this. The window is only hidden when closed, so the chart survives for
+    // savefig() and the next show().
+    if (!_isWidget) {
+      QEventLoop loop;
+      MadplotlibCloseWatcher watcher([&loop]() { loop.quit(); });
+      _chartView->installEventFilter(&watcher);
+      loop.exec();
+      _chartView->removeEventFilter(&watcher);
+    }
+
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "show(): -----";
+#endif
+  }
+
+  /* show_async(): displays the chart without blocking, so computation goes
+   * on while the window is open. The window lives on the GUI thread: the one
+   * of the QApplication of the program, whose event loop must be running,
+   * or else a thread Madplotlib starts, which creates a QApplication of its
+   * own and runs it until the program exits (this needs a platform that
+   * allows a GUI outside of main(), which macOS doesn't).
+   * plot(), append(), update() and the setters may be called from any
+   * thread afterwards. Each change takes the lock of the figure and asks
+   * the GUI thread for a redraw; redraws still pending are merged into one.
+   * Don't call show(), render() or savefig() on the figure after this.
+   * Returns a future that is ready once the window is closed, or the figure
+   * destroyed.
+   */
+  std::shared_future<void> show_async() {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "show_async(): " << _title;
+#endif
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (!_hasData()) {
+      qCritical() << "show_async()!!! Must set the data with plot() before "
+                     "show_async().";
+      std::promise<void> none;
+      none.set_value();
+      return none.get_future().share();
+    }
+
+    // the same window is shown again until it gets closed
+    if (_window && !_window->isClosed())
+      return _window->closed;
+
+    const std::shared_ptr<AsyncWindow> window(new AsyncWindow());
+    _window = window;
+    const std::weak_ptr<char> alive = _alive;
+    _runOnGui([this, window, alive]() {
+      if (alive.expired())
+        return;
+
+      std::lock_guard<std::recursive_mutex> lock(_mutex);
+      if (!_buildChart())
+        return;
+
+      if (!_chartView)
+        _createView();
+      _startDrainTimer();
+
+      MadplotlibCloseWatcher *watcher =
+          new MadplotlibCloseWatcher([window]() { window->close(); });
+      watcher->setParent(_chartView); // deleted along with the view
+      _chartView->installEventFilter(watcher);
+
+      _setUseOpenGL(_useOpenGL);
+      _chartView->setRenderHint(QPainter::Antialiasing);
+      _chartView->resize(_width, _height);
+      _chartView->show();
+    });
+
+    return window->closed;
+  }
+
+  /* AnimationStats: how well an animation kept its pace.
+   */
+  struct AnimationStats {
+    int frames;         // frames drawn
+    int skipped;        // frames skipped to catch up with the clock
+    qint64 meanFrameNs; // time to compute and draw a frame, on average
+    qint64 maxFrameNs;  // slowest frame
+    int saved;          // frames written to disk
+    int failed;         // frames that couldn't be written
+    int dropped;        // frames not written, the disk being behind
+
+    AnimationStats()
+        : frames(0), skipped(0), meanFrameNs(0), maxFrameNs(0), saved(0),
+          failed(0), dropped(0) {}
+  };
+
+  /* FrameCallback: updates the figure for frame number frame, usually
+   * through update() on the handles of series plotted beforehand, so the
+   * buffers of the series are reused. Returns false to end the animation.
+   */
+  typedef std::function<bool(Madplotlib &, int frame)> FrameCallback;
+
+  /* animate(): plays an animation, like FuncAnimation of matplotlib.
+   * callback is called every interval milliseconds, on the GUI thread, and
+   * only what it changed gets redrawn. Frames are paced by a clock: when a
+   * frame takes too long, the frames that were due meanwhile are skipped.
+   * frames: number of frames to play, 0 plays until the window is closed or
+   *         callback returns false.
+   * pattern: if given, every frame drawn is also saved as an image, to the
+   *          file pattern names with %1 replaced by the frame number padded
+   *          to 5 digits, like "frames/%1.png". Images are encoded by
+   *          background threads; frames they can't keep up with are dropped.
+   * Like show(), it blocks until the window is closed and returns the stats.
+   * Charts used as widgets animate in the background instead: animate()
+   * returns right away and animationStats() tells how it goes.
+   */
+  AnimationStats animate(FrameCallback callback, int interval = 40,
+                         int frames = 0, const QString &pattern = QString()) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "animate(): interval=" << interval << " frames=" << frames
+             << " pattern=" << pattern;
+#endif
+    if (interval <= 0) {
+      qCritical() << "animate(): interval must be > 0 but it is " << interval;
+      return AnimationStats();
+    }
+
+    if (!_buildChart())
+      return AnimationStats();
+
+    if (!_chartView)
+      _createView();
+    _startDrainTimer();
+
+    _setUseOpenGL(_useOpenGL);
+    _chartView->setRenderHint(QPainter::Antialiasing);
+    _chartView->resize(_width, _height);
+    _chartView->show();
+
+    _stopAnimation();
+    _animation.reset(new Animation());
+    Animation &animation = *_animation;
+    animation.callback = std::move(callback);
+    animation.interval = interval;
+    animation.frames = frames;
+    if (!pattern.isEmpty())
+      animation.exporter.reset(new FrameExporter(pattern));
+
+    animation.timer = new QTimer(_chartView); // deleted along with the view
+    animation.timer->setTimerType(Qt::PreciseTimer);
+    QObject::connect(animation.timer, &QTimer::timeout, animation.timer,
+                     [this]() { _animationFrame(); });
+    animation.clock.start();
+    animation.timer->start(interval);
+
+    if (_isWidget)
+      return animationStats();
+
+    // blocks until the window gets closed, like show(): the last frame stays
+    // on screen, and responsive, once the animation ends
+    QEventLoop loop;
+    MadplotlibCloseWatcher watcher([&loop]() { loop.quit(); });
+    _chartView->installEventFilter(&watcher);
+    loop.exec();
+    _chartView->removeEventFilter(&watcher);
+
+    _stopAnimation();
+    return animationStats();
+  }
+
+  /* animationStats(): the stats of the last animation, so far.
+   */
+  AnimationStats animationStats() const {
+    if (!_animation)
+      return AnimationStats();
+
+    AnimationStats stats = _animation->stats;
+    if (stats.frames)
+      stats.meanFrameNs = _animation->totalNs / stats.frames;
+    if (_animation->exporter) {
+      stats.saved = _animation->exporter->saved();
+      stats.failed = _animation->exporter->failed();
+      stats.dropped = _animation->exporter->dropped();
+    }
+    return stats;
+  }
+
+  void clear() {
+    FigureEdit edit(this);
+    for (SeriesData &data : _seriesVec) {
+      _releaseSeries(data);
+      if (data.inbox)
+        data.inbox->close();
+    }
+    _seriesVec.clear();
+
+    // the handles given so far must not reach the series plotted from now on
+    _freeSlots.clear();
+    for (int slot = _slots.size() - 1; slot >= 0; slot--) {
+      _slots[slot].index = -1;
+      _slots[slot].generation++;
+      _freeSlots.append(slot);
+    }
+    _labels.clear();
+
+    if (_images.size()) {
+      _images.clear();
+      _plotAreaDirty = true;
+    }
+  }
+
+  /* update(): replaces the samples of the series of handle, which keeps its
+   * style, capacity and decimation. Unlike plot() with a label, it costs no
+   * lookup, so refreshing many series per frame is cheap.
+   */
+  template <class X, class Y>
+  typename std::enable_if<is_plot_data<X>::value &&
+                          is_plot_data<Y>::value>::type
+  update(const SeriesHandle &handle, const X &x, const Y &y) {
+    FigureEdit edit(this);
+    SeriesData *data = _findSeries(handle);
+    if (!data)
+      return;
+
+    const auto &xs = _samples(x);
+    qreal dx = std::numeric_limits<qreal>::quiet_NaN();
+    if (std::is_same<typename std::decay<decltype(xs)>::type,
+                     UniformX>::value &&
+        xs.size() > 1)
+      dx = (xs.coeff(xs.size() - 1) - xs.coeff(0)) / (xs.size() - 1);
+
+    _storeSeries(*data, xs, _samples(y), dx);
+  }
+
+  /* update(): same as above, for series created by plot(y) or whose x is
+   * sampled at a fixed step. x starts over from the first value it had.
+   */
+  template <class Y>
+  typename std::enable_if<is_plot_data<Y>::value>::type
+  update(const SeriesHandle &handle, const Y &yIn) {
+    FigureEdit edit(this);
+    SeriesData *data = _findSeries(handle);
+    if (!data)
+      return;
+
+    if (!data->uniform) {
+      qCritical() << "update(): the series" << data->name
+                  << "needs x values.";
+      return;
+    }
+
+    const auto &y = _samples(yIn);
+    const int n = y.rows();
+    const qreal x0 = data->x0;
+    _storeSeries(*data,
+                 Eigen::ArrayXd::LinSpaced(n, x0, x0 + data->dx * (n - 1)), y,
+                 data->dx);
+  }
+
+  /* remove(): deletes the series of handle. The handle, and any copy of it,
+   * is invalid from now on.
+   */
+  void remove(const SeriesHandle &handle) {
+    FigureEdit edit(this);
+    SeriesData *data = _findSeries(handle);
+    if (!data)
+      return;
+
+    _releaseSeries(*data);
+    if (data->inbox)
+      data->inbox->close();
+
+    auto label = _labels.find(data->name);
+    if (label != _labels.end() && *label == handle.slot)
+      _labels.erase(label);
+    data->name.clear();
+    _updateLegend();
+
+    // the last series takes the place of the removed one, so the series stay
+    // packed at the front of _seriesVec
+    const int index = _slots[handle.slot].index;
+    const int last = _seriesVec.size() - 1;
+    if (index != last) {
+      _seriesVec[index] = std::move(_seriesVec[last]);
+      _slots[_seriesVec[index].slot].index = index;
+    }
+    _seriesVec.removeLast();
+
+    _slots[handle.slot].index = -1;
+    _slots[handle.slot].generation++;
+    _freeSlots.append(handle.slot);
+  }
+
+  /* contains(): tells if handle still refers to a series.
+   */
+  bool contains(const SeriesHandle &handle) const {
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return handle.slot >= 0 && handle.slot < _slots.size() &&
+           _slots[handle.slot].index >= 0 &&
+           _slots[handle.slot].generation == handle.generation;
+  }
+
+  /* setStyle(): changes the line, marker, color or label of the series of
+   * handle, described by a format string like the ones given to plot().
+   */
+  void setStyle(const SeriesHandle &handle, const QString &format) {
+    FigureEdit edit(this);
+    SeriesData *data = _findSeries(handle);
+    if (!data)
+      return;
+
+    const PlotStyle style = PlotStyle::parse(format);
+    if (!style.valid) {
+      qCritical() << "setStyle(): invalid format" << format;
+      return;
+    }
+
+    if (!style.label.isNull() && !_relabel(*data, style.label, "setStyle()"))
+      return;
+
+    PlotStyle merged = data->style;
+    merged.merge(style);
+    if (style.color.isValid())
+      data->color = style.color;
+
+    const bool isScatter = merged.isScatter();
+    if (data->series && data->isScatter != isScatter)
+      _releaseSeries(*data); // the Qt series can't change its type
+    data->isScatter = isScatter;
+    data->style = merged;
+
+    _applyStyle(*data);
+    data->dirty = true;
+    _refresh(*data);
+  }
+
+  /* setColor(): changes the color of the series of handle.
+   */
+  void setColor(const SeriesHandle &handle, const QColor &color) {
+    FigureEdit edit(this);
+    SeriesData *data = _findSeries(handle);
+    if (!data)
+      return;
+
+    data->color = color;
+    _applyStyle(*data);
+    data->dirty = true;
+    _refresh(*data);
+  }
+
+  /* setLabel(): changes the label of the series of handle, which append()
+   * then finds it by. A label names a single series: one that is already
+   * used by another series is rejected.
+   */
+  void setLabel(const SeriesHandle &handle, const QString &label) {
+    FigureEdit edit(this);
+    SeriesData *data = _findSeries(handle);
+    if (!data || !_relabel(*data, label, "setLabel()"))
+      return;
+
+    data->dirty = true;
+    _refresh(*data);
+  }
+
+private:
+  /* The bins of a series plotted by hist(). The counts are kept, so that
+   * hist(handle, x) only has to bin the new samples.
+   */
+  struct HistogramBins {
+    QVector<qreal> edges; // bins + 1 of them, increasing
+    bool uniform;         // the edges are evenly spaced
+    std::vector<quint64> counts;
+  };
+
+  /* The files a series plotted from a MappedArray reads, and the window of
+   * samples it holds: one every stride from first to last.
+   */
+  struct MappedSeries {
+    std::shared_ptr<MappedArray> x; // NULL: x is the index of the sample
+    std::shared_ptr<MappedArray> y;
+    qint64 first, last, stride;
+    bool preview;  // the window was sampled, since y wasn't indexed yet
+    bool waiting;  // the figure is redrawn once x and y are indexed
+    bool unsorted; // x turned out unsorted: the window stays as it is
+    MappedSeries()
+        : first(-1), last(-1), stride(0), preview(false), waiting(false),
+          unsorted(false) {}
+  };
+
+  /* The samples of a series decimated with "lod" and their min/max pyramid:
+   * level k bounds the samples by blocks of LOD_FANOUT^(k+1). Any range of
+   * samples is bounded by at most 2 * LOD_FANOUT blocks per level, so the
+   * points of a view cost O(pixels log n) whatever the zoom. x is kept in
+   * double, so that large values such as timestamps stay apart.
+   */
+  struct LodIndex {
+    std::vector<double> x; // empty when x is computed as x0 + dx * i
+    std::vector<float> y;
+    qreal x0, dx;
+    std::vector<std::vector<float>> mins, maxs;
+    LodIndex() : x0(0), dx(1) {}
+
+    qint64 size() const { return y.size(); }
+    qreal xAt(qint64 i) const { return x.empty() ? x0 + dx * i : x[i]; }
+  };
+
+  /* The range and ticks Subplots gives an axis shared by its charts, in
+   * place of the ones of the data of the chart. The first chart rounds the
+   * range to nice numbers, the others take its axis as is.
+   */
+  struct SharedAxis {
+    bool active;
+    bool nice; // the range still has to be rounded to nice numbers
+    qreal min, max;
+    int tickCount;
+    SharedAxis() : active(false), nice(false), min(0), max(0), tickCount(0) {}
+  };
+
+  /* Everything plot() knows about a series. The Qt series is only created
+   * by _syncSeries() on the GUI thread, so a figure can be described from
+   * any thread.
+   */
+  struct SeriesData {
+    std::shared_ptr<QtCharts::QXYSeries> series;
+    QVector<QPointF> points; // points handed to the Qt series
+    QString name;            // label displayed in the legend
+    int slot;                // slot of the handle of the series
+    PlotStyle style;
+    bool isScatter;
+    bool isDensity; // scatter plot drawn as a density image by _rasterPlotArea()
+    qreal markersize;
+    QColor color;     // fill color, before alpha is applied
+    QColor edgecolor; // outline of the markers, invalid to match color
+    qreal alpha;
+    quint32 linewidth;
+    QPen pen; // made by _applyStyle() from the fields above
+    QBrush brush;
+    PlotOptions::Decimation decimate;
+    std::shared_ptr<SampleQueue> inbox; // made by ingest()
+    std::shared_ptr<HistogramBins> histogram; // made by hist()
+    std::shared_ptr<MappedSeries> mapped;     // made by plot() of a file
+    std::shared_ptr<LodIndex> lod;            // made by decimate="lod"
+
+    Eigen::ArrayXf x; // samples kept for append(): a ring buffer when the
+    Eigen::ArrayXf y; // series has a capacity, a growing array otherwise
+    int capacity;     // max number of samples, 0 means unbounded
+    int head;         // index of the oldest sample in x and y
+    int count;        // number of valid samples in x and y
+    bool dirty;       // the Qt series is out of date
+
+    bool uniform;     // x isn't stored in x, but computed as x0 + dx * i,
+    qreal x0, dx;     // where i counts the samples since the first one
+    qint64 start;     // value of i for the oldest sample stored
+
+    qreal xMin, xMax; // bounds of the data, +inf/-inf when there's none
+    qreal yMin, yMax;
+    bool boundsStale; // samples were dropped, the bounds must be measured
+    Eigen::Array4Xf blocks; // xMin, xMax, yMin, yMax of every RING_BLOCK
+                            // samples of the ring buffer
+    qreal decimated[2]; // x range the points were last decimated for
+
+    SeriesData()
+        : slot(-1), isScatter(false), isDensity(false),
+          markersize(DEFAULT_MARKERSZ),
+          alpha(DEFAULT_ALPHA), linewidth(DEFAULT_LINEW),
+          decimate(PlotOptions::DecimateNone), capacity(0),
+          head(0), count(0), dirty(false), uniform(false), x0(0), dx(0),
+          start(0), xMin(std::numeric_limits<qreal>::infinity()),
+          xMax(-xMin), yMin(xMin), yMax(-xMin), boundsStale(false) {
+      decimated[0] = decimated[1] = 0;
+    }
+  };
+
+  /* The images of hist2d(), hexbin() and imshow(), drawn under the series
+   * by _rasterPlotArea().
+   */
+  struct ImageData {
+    bool hexagonal;
+    int nx, ny; // rectangles, or hexagons of the first lattice, along x and y
+    qreal extent[4]; // xMin, xMax, yMin, yMax of the image
+    std::vector<quint32> counts; // hexbin(): both lattices one after the other
+    quint32 peak;
+    QVector<QRgb> colormap;
+    QImage image; // one pixel per rectangle, the top row is the last one
+    ImageData() : hexagonal(false), nx(0), ny(0), peak(0) {}
+  };
+
+  /* _plotSeries(): stores x and y in the series named by the label keyword,
+   * or in a new series when there's no label, along with its style. dx is
+   * the step of x when it is sampled at a fixed step, in which case x isn't
+   * stored, or NaN.
+   */
+  template <class Dx, class Dy, class... Args>
+  SeriesHandle _plotSeries(const Eigen::DenseBase<Dx> &x,
+                           const Eigen::DenseBase<Dy> &y, qreal dx,
+                           const Args &...args) {
+    FigureEdit edit(this);
+    // every keyword is matched to its field at compile time
+    const PlotOptions options = PlotOptions::from(args...);
+    const PlotStyle &style = options.style;
+    const QString &label = style.label;
+
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "plot(x,y): line:" << style.line << " marker:" << style.marker
+             << " alpha:" << options.alpha << " color:" << options.color
+             << " edgecolor:" << options.edgecolor
+             << " linewidth:" << options.linewidth
+             << " markersize:" << options.markersize
+             << " decimate:" << options.decimate
+             << " density:" << options.density;
+#endif
+
+    if (!style.valid)
+      return SeriesHandle();
+
+    if (options.decimate == PlotOptions::DecimateUnknown ||
+        options.density == PlotOptions::DensityUnknown)
+      return SeriesHandle();
+
+    if (options.capacity < 0) {
+      qCritical() << "plot(x,y): capacity must be >= 0 but it is "
+                  << options.capacity;
+      return SeriesHandle();
+    }
+
+    // Make a copy because it's show() who setup these things
+    if (_legend.isEmpty() != label.isEmpty())
+      _dirtyParts |= LegendDirty;
+    _legend = label;
+#if (DEBUG > 1) && (DEBUG < 3)
+    if (_legend.size())
+      qDebug() << "plot(x,y): label=" << _legend;
+#endif
+
+    const SeriesHandle handle = _newSeries(label);
+    SeriesData &data = _seriesVec[_slots[handle.slot].index];
+    data.histogram.reset(); // set again by hist()
+    data.mapped.reset();    // and by plot() of a file
+
+    const bool isScatter = style.isScatter();
+    if (data.series && data.isScatter != isScatter)
+      _releaseSeries(data); // the Qt series can't change its type
+    data.isScatter = isScatter;
+    data.style = style;
+    data.markersize = options.markersize;
+    data.name = label;
+    data.capacity = options.capacity;
+
+    // Big scatter plots are drawn as a density image: every point counts, so
+    // they aren't decimated either
+    const qint64 points = std::max<qint64>(x.size(), options.capacity);
+    data.isDensity =
+        isScatter && (options.density == PlotOptions::DensityOn ||
+                      (options.density == PlotOptions::DensityAuto &&
+                       points >= DEFAULT_DENSITY_POINTS));
+    data.decimate =
+        data.isDensity ? PlotOptions::DecimateNone : options.decimate;
+
+    // Customize series color and transparency
+    data.color = options.color.isValid() ? options.color : style.color;
+    if (!data.color.isValid())
+      data.color = _colors[_colorIdx++];
+    if (_colorIdx >= _colors.size())
+      _colorIdx = 0;
+    data.edgecolor = options.edgecolor;
+    data.alpha = options.alpha;
+    data.linewidth = options.linewidth;
+    _applyStyle(data);
+
+    _storeSeries(data, x, y, dx);
+
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "plot(x,y): -----";
+#endif
+    return handle;
+  }
+
+  /* _storeSeries(): replaces the samples of data by x and y, following the
+   * capacity and decimation of data.
+   */
+  template <class Dx, class Dy>
+  void _storeSeries(SeriesData &data, const Eigen::DenseBase<Dx> &xIn,
+                    const Eigen::DenseBase<Dy> &yIn, qreal dx) {
+    static_assert(Dx::ColsAtCompileTime == 1 && Dy::ColsAtCompileTime == 1,
+                  "plot(): x and y must be column vectors");
+    static_assert(is_sample_scalar<typename Dx::Scalar>::value &&
+                      is_sample_scalar<typename Dy::Scalar>::value,
+                  "plot(): x and y must hold real numbers");
+
+    // matrices are plotted through their array view, which costs nothing
+    const auto &x = _asArray(xIn.derived());
+    const auto &y = _asArray(yIn.derived());
+
+    if (x.rows() != y.rows()) {
+      qCritical() << "plot(x,y): x.sz=" << x.rows() << " != y.sz=" << y.rows();
+      exit(-1);
+    }
+
+    if (x.rows() == 0 || y.rows() == 0) {
+      qCritical() << "plot(x,y): axis size must be > 0 but it is x.sz="
+                  << x.rows() << " y.sz=" << y.rows();
+      exit(-1);
+    }
+
+    const PlotOptions::Decimation decimate = data.decimate;
+    const int capacity = data.capacity;
+
+    // a bounded series only keeps (and displays) its last capacity points
+    const int keep = (capacity > 0) ? std::min<int>(capacity, x.rows())
+                                    : static_cast<int>(x.rows());
+
+    // Unbounded series take over their points on the first append(). Bounded
+    // series own their samples so append() can rotate them, and decimated
+    // ones so they can be decimated again.
+    data.head = data.count = 0;
+    data.lod.reset();
+    data.uniform = !qIsNaN(dx);
+    data.x.resize(data.uniform ? 0 : capacity);
+    data.y.resize(capacity);
+    data.blocks.resize(4, (capacity + RING_BLOCK - 1) / RING_BLOCK);
+    if (data.uniform) {
+      data.x0 = x.coeff(x.rows() - keep);
+      data.dx = dx;
+      data.start = 0;
+    }
+
+    // All the points are handed to the Qt series at once: a single replace()
+    // emits a single signal, while append()/replace(i) would emit one per
+    // point.
+    // The min and max values of both axis are found in the same pass. They
+    // are kept by the series, show() derives the range of the axis from them.
+    qreal xMin, xMax, yMin, yMax;
+    QVector<QPointF> &points = data.points;
+    typedef typename std::decay<decltype(x)>::type ArrayX;
+    typedef typename std::decay<decltype(y)>::type ArrayY;
+    if (!(has_direct_access<ArrayX>::value && has_direct_access<ArrayY>::value) &&
+        decimate == PlotOptions::DecimateNone && capacity == 0) {
+      // Expressions, and x sampled at a fixed step, are evaluated coefficient
+      // by coefficient right into the points, so no temporary array is ever
+      // allocated for them.
+      _evalPoints(points, x, y, xMin, xMax, yMin, yMax);
+    } else if (data.uniform) {
+      // only y is read, x is generated on the fly and its bounds are known
+      const SampleRef<typename ArrayY::Scalar> ys = y.tail(keep);
+      _minMax(ys, yMin, yMax);
+      _uniformBounds(data.x0, dx, keep, xMin, xMax);
+
+      _checkLod(data, ys);
+      if (capacity > 0 || _keepsSamples(data))
+        _pushSamples(data, ys);
+
+      if (!_decimate(data, x.tail(keep), ys, xMin, xMax))
+        _fillUniform(points, data.x0, dx, ys);
+    } else {
+      // Stored data is read in place. Expressions are evaluated once here,
+      // since decimation and ring buffers go over the samples again.
+      const SampleRef<typename ArrayX::Scalar> xs = x.tail(keep);
+      const SampleRef<typename ArrayY::Scalar> ys = y.tail(keep);
+      _minMax(xs, ys, xMin, xMax, yMin, yMax);
+
+      _checkLod(data, xs);
+      if (capacity > 0 || _keepsSamples(data))
+        _pushSamples(data, xs, ys);
+
+      if (!_decimate(data, xs, ys, xMin, xMax))
+        _fillPoints(points, xs, ys);
+    }
+    _growLimits(xMin, xMax, yMin, yMax);
+
+#if (DEBUG > 1) && (DEBUG < 3)
+    qDebug() << "plot(x,y): xrange [" << xMin << "," << xMax << "]  yrange ["
+             << yMin << "," << yMax << "]";
+    qDebug() << "plot(x,y):"
+             << (data.isScatter ? "scatter plot" : "line plot");
+    for (int i = 0; i < points.size(); i++)
+      qDebug() << "plot(x,y): x[" << i << "]=" << points[i].x() << " y[" << i
+               << "]=" << points[i].y();
+#endif
+
+    data.xMin = xMin;
+    data.xMax = xMax;
+    data.yMin = yMin;
+    data.yMax = yMax;
+    data.boundsStale = false;
+
+    data.dirty = true;
+    _refresh(data);
+  }
+
+  /* _applyStyle(): makes the pen and brush of data from its colors, alpha
+   * and line width.
+   */
+  static void _applyStyle(SeriesData &data) {
+    QColor fillColor = data.color;
+    fillColor.setAlphaF(data.alpha);
+
+    QPen pen;
+    pen.setWidth(data.linewidth);
+
+    if (data.isScatter) {
+      if (!data.edgecolor.isValid()) {
+        pen.setColor(fillColor); // outline should be invisible
+#if (DEBUG > 1) && (DEBUG < 3)
+        qDebug() << "plot(x,y): fillColor=" << fillColor;
+#endif
+      } else {
+#if (DEBUG > 1) && (DEBUG < 3)
+        qDebug() << "plot(x,y): edgecolor=" << data.edgecolor;
+#endif
+        QColor edgeColor = data.edgecolor;
+        edgeColor.setAlphaF(data.alpha);
+        pen.setColor(edgeColor); // create circle outline
+      }
+    } else {
+      pen.setStyle(data.style.penStyle());
+      pen.setColor(fillColor);
+    }
+
+    data.pen = pen;
+    data.brush = QBrush(fillColor);
+  }
+
+  /* _newSeries(): the handle of the series plot() writes to. A series that
+   * has a label is replaced by the next plot() with the same label, the
+   * others always get a slot of their own.
+   */
+  SeriesHandle _newSeries(const QString &label) {
+    if (label.size()) {
+      auto itr = _labels.constFind(label);
+      if (itr != _labels.constEnd())
+        return SeriesHandle(*itr, _slots[*itr].generation);
+    }
+
+    int slot;
+    if (_freeSlots.size()) {
+      slot = _freeSlots.last();
+      _freeSlots.removeLast();
+    } else {
+      slot = _slots.size();
+      _slots.append(SeriesSlot());
+    }
+
+    _slots[slot].index = _seriesVec.size();
+    _seriesVec.append(SeriesData());
+    _seriesVec.last().slot = slot;
+    if (label.size())
+      _labels.insert(label, slot);
+
+    return SeriesHandle(slot, _slots[slot].generation);
+  }
+
+  /* _findSeries(): the series of a handle or label, or NULL if there's none.
+   * caller names the call that reports it.
+   */
+  SeriesData *_findSeries(const SeriesHandle &handle,
+                          const char *caller = "Madplotlib") {
+    if (!contains(handle)) {
+      qCritical().nospace() << caller << ": the series handle " << handle.slot
+                            << " is invalid or was removed.";
+      return NULL;
+    }
+    return &_seriesVec[_slots[handle.slot].index];
+  }
+
+  SeriesData *_findSeries(const QString &label, const char *caller) {
+    auto itr = _labels.constFind(PlotStyle::labelOf(label));
+    if (itr == _labels.constEnd()) {
+      qCritical().nospace() << caller << ": there's no series labeled "
+                            << label << ".";
+      return NULL;
+    }
+    return &_seriesVec[_slots[*itr].index];
+  }
+
+  /* _relabel(): gives data the label, unless another series has it. caller
+   * names the call that reports it. Returns false if the label was taken.
+   */
+  bool _relabel(SeriesData &data, const QString &label, const char *caller) {
+    auto taken = _labels.constFind(label);
+    if (label.size() && taken != _labels.constEnd() && *taken != data.slot) {
+      qCritical().nospace() << caller << ": the label " << label
+                            << " is already used by another series.";
+      return false;
+    }
+
+    auto old = _labels.find(data.name);
+    if (old != _labels.end() && *old == data.slot)
+      _labels.erase(old);
+    if (label.size())
+      _labels.insert(label, data.slot);
+
+    data.name = label;
+    data.style.label = label;
+    _updateLegend();
+    return true;
+  }
+
+  /* _updateLegend(): the legend is shown while any series has a label.
+   */
+  void _updateLegend() {
+    QString legend;
+    for (const SeriesData &data : _seriesVec)
+      if (data.name.size())
+        legend = data.name;
+
+    if (legend.isEmpty() != _legend.isEmpty())
+      _dirtyParts |= LegendDirty;
+    _legend = legend;
+  }
+
+  /* _hasData(): true once there's something to draw. */
+  bool _hasData() const { return _seriesVec.size() || _images.size(); }
+
+  /* _buildChart(): sets up title, legend, axes and series of the chart.
+   * This is everything show() and render() have in common.
+   * Only the parts that changed since the last call are handed to Qt: the
+   * setters mark the decorations they touch in _dirtyParts, each series
+   * knows if its points are out of date, and the range of an axis is only
+   * set when the data moved it. Updating one series out of many costs about
+   * as much as that series alone.
+   * The steps that deal with data only, _prepareChart() and _makePoints(),
+   * are run by Subplots on worker threads, in between the other ones.
+   */
+  bool _buildChart() {
+    if (!_hasData()) {
+      qCritical() << "show()!!! Must set the data with plot() before show().";
+      return false;
+    }
+
+    _prepareChart();
+    const bool newAxis = _buildFrame();
+    _makePoints();
+    _buildSeries(newAxis);
+    return true;
+  }
+
+  /* _buildFrame(): creates the chart if needed and sets up its title, legend
+   * and axes. Returns true if an axis was created, which the series have to
+   * be attached to.
+   */
+  bool _buildFrame() {
+    if (!_chart) {
+      _chart = new QtCharts::QChart();
+
+      /* Other possible customizations such as margins and background color */
+      // Remove (fat) exterior margins from QChart
+      _chart->layout()->setContentsMargins(0, 0, 0, 0);
+      _chart->setBackgroundRoundness(0);
+      _dirtyParts = AllDirty;
+
+      // a new layout, e.g. a resize, needs a new density image
+      _plotAreaConnection = QObject::connect(
+          _chart, &QtCharts::QChart::plotAreaChanged, [this]() {
+            std::lock_guard<std::recursive_mutex> lock(_mutex);
+            if (_plotAreaShown)
+              _rasterPlotArea();
+          });
+    }
+
+    /* Customize chart title */
+
+    if (_dirtyParts & TitleDirty) {
+      QFont font;
+      font.setPixelSize(12);
+      font.setWeight(QFont::Bold);
+      _chart->setTitleFont(font);
+      _chart->setTitle(_title);
+    }
+
+    // TODO: investigate detaching the legend for custom positioning
+    // https://doc.qt.io/qt-5/qtcharts-legend-example.html
+
+    if (_dirtyParts & LegendDirty) {
+      if (_legendPos)
+        _chart->legend()->setAlignment(
+            static_cast<Qt::AlignmentFlag>(_legendPos));
+
+      if (_legend.size())
+        _chart->legend()->setVisible(true);
+      else
+        _chart->legend()->setVisible(false);
+    }
+
+    /* Customize X, Y axis and categories */
 
 #if (DEBUG > 1) && (DEBUG < 3)
-    qDebug() << "xticks(): xticks.sz=" << _xTicks.size();
-    for (int i = 0; i < _xTicks.size(); i++)
-      qDebug() << "\t" << _xTicks[i].second << " = " << _xTicks[i].first;
+    qDebug() << "_buildChart(): xrange [" << _xMin << "," << _xMax << "] "
+             << " yrange [" << _yMin << "," << _yMax << "]";
+#endif
+
+    // charts of Subplots may share their axes
+    const SharedAxis x =
+        _sharedX.active ? _sharedX : _ownAxis(_xMin, _xMax, _xTickCount);
+    const SharedAxis y =
+        _sharedY.active ? _sharedY : _ownAxis(_yMin, _yMax, _yTickCount);
+    const bool newXAxis =
+        _updateAxis(_xAxisBottom, Qt::AlignBottom, _showXticks, _xTicks,
+                    _xLabel, x.tickCount, x.min, x.max, x.nice,
+                    _dirtyParts & XAxisDirty, _shownRange);
+    bool newAxis = newXAxis;
+    newAxis |= _updateAxis(_yAxisLeft, Qt::AlignLeft, _showYticks, _yTicks,
+                           _yLabel, y.tickCount, y.min, y.max, y.nice,
+                           _dirtyParts & YAxisDirty, _shownRange + 2);
+    _dirtyParts = 0;
+
+    // Decimated series only hold the points of the visible range: xlim(),
+    // axis(), zooming and panning the chart view decimate them again from
+    // their samples right away.
+    QtCharts::QValueAxis *xValues =
+        static_cast<QtCharts::QValueAxis *>(_xAxisBottom);
+    if (newXAxis) {
+      _rangeConnection = QObject::connect(
+          xValues, &QtCharts::QValueAxis::rangeChanged,
+          [this](qreal min, qreal max) {
+            std::lock_guard<std::recursive_mutex> lock(_mutex);
+            if (!_redecimate(min, max))
+              return;
+            for (SeriesData &data : _seriesVec)
+              if ((data.lod || _keepsSamples(data)) && data.dirty &&
+                  data.series && data.series->chart() == _chart)
+                _syncSeries(data);
+          });
+    }
+    _xRange[0] = xValues->min();
+    _xRange[1] = xValues->max();
+    return newAxis;
+  }
+
+  /* _createView(): creates the view of the chart. The x axis is zoomed in
+   * with a rubber band, out with the right button, zoomed with the wheel and
+   * panned with the middle button. All of them move the range of the axis,
+   * and rangeChanged() decimates the series again for it.
+   */
+  void _createView() {
+    _chartView = new QtCharts::QChartView(_chart);
+    _chartView->setRubberBand(QtCharts::QChartView::HorizontalRubberBand);
+
+    MadplotlibNavigator *navigator = new MadplotlibNavigator(_chartView);
+    navigator->setParent(_chartView); // deleted along with the view
+    _chartView->viewport()->installEventFilter(navigator);
+  }
+
+  /* _makePoints(): brings the points of the series up to date with the
+   * range of the x axis: series decimated from their samples are decimated
+   * again if it moved, ring buffers are laid out. It deals with no Qt
+   * object.
+   */
+  void _makePoints() {
+    _redecimate(_xRange[0], _xRange[1]);
+    for (SeriesData &data : _seriesVec)
+      if (data.dirty && data.capacity > 0)
+        _layoutRing(data);
+  }
+
+  /* _buildSeries(): hands the points of the series that changed to Qt, adds
+   * the new ones to the chart and draws the density image.
+   */
+  void _buildSeries(bool newAxis) {
+    /* Add series of data */
+    // series released since the last redraw of show_async() leave the chart
+    for (const std::shared_ptr<QtCharts::QXYSeries> &series : _retiredSeries)
+      if (series->chart() == _chart)
+        _chart->removeSeries(series.get());
+    _retiredSeries.clear();
+
+    // Only new series are added to the chart. They all stay on it until
+    // they are released, since removeAllSeries() would delete them.
+    for (SeriesData &data : _seriesVec) {
+      if (data.dirty) {
+        _syncSeries(data);
+        _plotAreaDirty = _plotAreaDirty || data.isDensity;
+      }
+
+      const bool added = (data.series->chart() != _chart);
+      if (added)
+        _chart->addSeries(data.series.get());
+
+      if (added || newAxis) {
+        data.series->attachAxis(_xAxisBottom);
+        data.series->attachAxis(_yAxisLeft);
+      }
+    }
+
+    if (_chartView)
+      _setUseOpenGL(_useOpenGL);
+
+    // the density image follows the data and the range of the axes, and the
+    // plot area through plotAreaChanged()
+    if (_plotAreaDirty ||
+        !std::equal(_shownRange, _shownRange + 4, _plotAreaRange)) {
+      std::copy(_shownRange, _shownRange + 4, _plotAreaRange);
+      _rasterPlotArea();
+    }
+  }
+
+  /* _prepareChart(): the part of _buildChart() that only deals with the data
+   * of the figure and no Qt object: it drains the queues of ingest(), cuts
+   * the windows of mapped files and finds the range of the axes.
+   */
+  void _prepareChart() {
+    _drainInboxes();
+    _cutMappedWindows();
+    _autoscale();
+  }
+
+  /* _ownAxis(): the range and ticks of an axis that isn't shared.
+   */
+  SharedAxis _ownAxis(qreal min, qreal max, int tickCount) const {
+    SharedAxis axis;
+    axis.nice = !_customLimits;
+    axis.min = min;
+    axis.max = max;
+    axis.tickCount = tickCount;
+    return axis;
+  }
+
+  /* _rasterPlotArea(): draws the images of hist2d(), hexbin() and imshow(), then
+   * every density series, into one image laid under the plot area of the
+   * chart. Each density series adds its color to the pixels its points fall
+   * on, more opaque where there are more points.
+   */
+  void _rasterPlotArea() {
+    bool any = _images.size();
+    for (const SeriesData &data : _seriesVec)
+      any = any || data.isDensity;
+
+    _plotAreaDirty = false;
+    if (!any) {
+      if (_plotAreaShown)
+        _chart->setPlotAreaBackgroundVisible(false);
+      _plotAreaShown = false;
+      return;
+    }
+
+    const QRectF area = _chart->plotArea();
+    const int width = qRound(area.width());
+    const int height = qRound(area.height());
+    if (width <= 0 || height <= 0 || !_xAxisBottom || !_yAxisLeft)
+      return;
+
+    // both kinds of axis are value axes, nice numbers may have widened them
+    const QtCharts::QValueAxis *axisX =
+        static_cast<QtCharts::QValueAxis *>(_xAxisBottom);
+    const QtCharts::QValueAxis *axisY =
+        static_cast<QtCharts::QValueAxis *>(_yAxisLeft);
+    const qreal xMin = axisX->min(), xMax = axisX->max();
+    const qreal yMin = axisY->min(), yMax = axisY->max();
+
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    if (_images.size()) {
+      // chart values -> pixels of the image, y grows downwards
+      const QTransform toPixel =
+          QTransform::fromTranslate(-xMin, -yMax) *
+          QTransform::fromScale(width / (xMax - xMin), -height / (yMax - yMin));
+
+      QPainter painter(&image);
+      for (const ImageData &hist : _images)
+        _paintImage(painter, hist, toPixel);
+    }
+
+    std::vector<quint32> counts;
+    for (const SeriesData &data : _seriesVec) {
+      if (!data.isDensity)
+        continue;
+
+      const quint32 peak = _countDensity(counts, data.points, width, height,
+                                         xMin, xMax, yMin, yMax);
+      _blendDensity(image, counts, peak, data.brush.color());
+    }
+
+    QBrush brush(image);
+    brush.setTransform(QTransform::fromTranslate(area.x(), area.y()));
+    _chart->setPlotAreaBackgroundBrush(brush);
+    _chart->setPlotAreaBackgroundVisible(true);
+    _plotAreaShown = true;
+  }
+
+  /* _cutMappedWindows(): reads the samples of every mapped series again if
+   * the x range shown moved since its window was cut.
+   */
+  void _cutMappedWindows() {
+    for (SeriesData &data : _seriesVec) {
+      if (!data.mapped)
+        continue;
+
+      Eigen::ArrayXd xs;
+      Eigen::ArrayXf ys;
+      if (_cutWindow(*data.mapped, xs, ys)) {
+        const qreal xMin = _xMin, xMax = _xMax;
+        if (xs.rows())
+          _storeSeries(data, xs, ys, std::numeric_limits<qreal>::quiet_NaN());
+        else
+          _storeSeries(data, _mappedIndex(*data.mapped), ys, 1);
+        _xMin = xMin;
+        _xMax = xMax;
+      }
+      // the index of x may be done while the window didn't change
+      _mappedBounds(data);
+    }
+  }
+
+  /* _cutWindow(): reads the samples of mapped within the x limits, or all
+   * of them without limits, plus one on each side so lines reach the edges
+   * of the chart. Past DEFAULT_MAPPED_POINTS samples, they are reduced by
+   * blocks of stride samples to the first, min, max and last of each block,
+   * like "m4" does, from the index of y once stride reaches MAPPED_BLOCK.
+   * Until y is indexed, such a window is only sampled every stride. x gets
+   * their x, or their index when mapped has no x: it is left empty when
+   * that index is the sample's own.
+   * Returns false if the window didn't change, or couldn't be read.
+   */
+  bool _cutWindow(MappedSeries &mapped, Eigen::ArrayXd &x, Eigen::ArrayXf &y) {
+    if (mapped.x && mapped.x->indexed() && !mapped.x->isSorted()) {
+      if (!mapped.unsorted)
+        qCritical() << "plot(mapped): x must be sorted and can't hold NaNs,"
+                    << "the series no longer follows the range of the axis.";
+      mapped.unsorted = true;
+      return false;
+    }
+
+    const qint64 n = mapped.y->size();
+    qint64 first = 0, last = n - 1;
+    if (_customLimits && !mapped.x) {
+      first = qBound<qint64>(0, qint64(std::floor(_xMin)), n - 1);
+      last = qBound<qint64>(first, qint64(std::ceil(_xMax)), n - 1);
+    } else if (_customLimits) {
+      // first sample >= xMin and last one <= xMax, then one more each side
+      first = std::max<qint64>(0, mapped.x->search(_xMin, false) - 1);
+      last = std::min(n - 1, std::max(first, mapped.x->search(_xMax, true)));
+    }
+
+    // strides of whole blocks are reduced from the index
+    qint64 stride = (last - first) / DEFAULT_MAPPED_POINTS + 1;
+    if (stride >= MAPPED_BLOCK)
+      stride = (stride + MAPPED_BLOCK - 1) / MAPPED_BLOCK * MAPPED_BLOCK;
+    const bool preview = stride >= MAPPED_BLOCK && !mapped.y->indexed();
+    if (first == mapped.first && last == mapped.last &&
+        stride == mapped.stride && preview == mapped.preview)
+      return false;
+
+#if (DEBUG > 1) && (DEBUG < 3)
+    qDebug() << "_cutWindow(): samples [" << first << "," << last
+             << "] stride=" << stride << "preview=" << preview;
+#endif
+    std::vector<qint64> index;
+    std::vector<float> values;
+    if (preview) {
+      for (qint64 i = first; i < last; i += stride)
+        index.push_back(i);
+      index.push_back(last);
+      values.resize(index.size());
+      if (!mapped.y->gather(index, values.data()))
+        return false;
+      _redrawWhenIndexed(mapped);
+    } else if (stride >= MAPPED_BLOCK) {
+      if (!mapped.y->reduceIndexed(first, last, stride, index, values))
+        return false;
+    } else if (!mapped.y->reduce(first, last, stride, index, values)) {
+      return false;
+    }
+
+    const int count = static_cast<int>(index.size());
+    y = Eigen::Map<const Eigen::ArrayXf>(values.data(), count);
+    if (mapped.x) {
+      std::vector<float> xs(count);
+      if (!mapped.x->gather(index, xs.data()))
+        return false;
+      x = Eigen::Map<const Eigen::ArrayXf>(xs.data(), count).cast<double>();
+      if (!mapped.x->indexed())
+        _redrawWhenIndexed(mapped);
+    } else if (stride > 1) {
+      x = Eigen::Map<const Eigen::Array<qint64, Eigen::Dynamic, 1>>(
+              index.data(), count)
+              .cast<double>();
+    } else {
+      x.resize(0);
+    }
+
+    mapped.first = first;
+    mapped.last = last;
+    mapped.stride = stride;
+    mapped.preview = preview;
+    return true;
+  }
+
+  /* _redrawWhenIndexed(): has a chart on screen drawn again once the arrays
+   * of mapped are indexed, so that its preview is replaced and x checked.
+   * Other charts pick the index up the next time they are drawn.
+   */
+  void _redrawWhenIndexed(MappedSeries &mapped) {
+    if (mapped.waiting)
+      return;
+    mapped.waiting = true;
+
+    const std::weak_ptr<char> alive = _alive;
+    std::function<void()> redraw = [this, alive]() {
+      if (!QCoreApplication::instance())
+        return;
+      _runOnGui([this, alive]() {
+        if (alive.expired())
+          return;
+
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        if (_chartView && _hasData())
+          _buildChart();
+      });
+    };
+    for (MappedArray *array : {mapped.x.get(), mapped.y.get()})
+      if (array)
+        array->whenIndexed(redraw);
+  }
+
+  /* _mappedIndex(): x of the window of a series mapped without x, when it
+   * was read in full.
+   */
+  static UniformX _mappedIndex(const MappedSeries &mapped) {
+    return Eigen::ArrayXd::LinSpaced(mapped.last - mapped.first + 1,
+                                     mapped.first, mapped.last);
+  }
+
+  /* _mappedBounds(): the x bounds of a mapped series are those of the whole
+   * file, not of its window, so that the chart can be zoomed out again. A
+   * mapped x is bounded by its index, and by its window until then.
+   */
+  static void _mappedBounds(SeriesData &data) {
+    const MappedSeries &mapped = *data.mapped;
+    const qint64 n = mapped.y->size();
+    float lo, hi;
+    if (!mapped.x) {
+      data.xMin = 0;
+      data.xMax = n - 1;
+    } else if (mapped.x->bounds(0, n - 1, lo, hi)) {
+      data.xMin = lo;
+      data.xMax = hi;
+    }
+  }
+
+  /* _hist(): bins the samples of x for hist() and plots the histogram. */
+  template <class... Args>
+  SeriesHandle _hist(const Eigen::ArrayXf &x, const QVector<qreal> &edges,
+                     const Args &...args) {
+    std::shared_ptr<HistogramBins> bins(new HistogramBins);
+    const int n = edges.size() - 1;
+    const qreal width = (edges[n] - edges[0]) / n;
+    bins->edges = edges;
+    bins->uniform = true;
+    for (int i = 1; i < n; i++)
+      bins->uniform = bins->uniform &&
+                      std::abs(edges[i] - (edges[0] + width * i)) <= 1e-9 * width;
+
+    std::vector<quint32> counts;
+    _binSamples(*bins, x, counts);
+    bins->counts.assign(counts.begin(), counts.end());
+
+    // the outline is plotted as it is, every bar is needed
+    FigureEdit edit(this);
+    Eigen::ArrayXf outlineX, outlineY;
+    _histogramOutline(*bins, outlineX, outlineY);
+    const SeriesHandle handle = _plotSeries(
+        outlineX, outlineY, std::numeric_limits<qreal>::quiet_NaN(), args...);
+    SeriesData *data = _findSeries(handle);
+    if (data)
+      data->histogram = bins;
+    return handle;
+  }
+
+  /* _storeHistogram(): hands the counts of the histogram of data to its
+   * series.
+   */
+  void _storeHistogram(SeriesData &data) {
+    Eigen::ArrayXf outlineX, outlineY;
+    _histogramOutline(*data.histogram, outlineX, outlineY);
+    _storeSeries(data, outlineX, outlineY,
+                 std::numeric_limits<qreal>::quiet_NaN());
+  }
+
+  /* _histogramOutline(): the points that outline the bars of bins, bar
+   * after bar: up the left edge, across the top, down the right edge.
+   */
+  static void _histogramOutline(const HistogramBins &bins, Eigen::ArrayXf &x,
+                                Eigen::ArrayXf &y) {
+    const int n = bins.counts.size();
+    x.resize(3 * n + 1);
+    y.resize(3 * n + 1);
+    x[0] = bins.edges[0];
+    y[0] = 0;
+    for (int i = 0; i < n; i++) {
+      x[3 * i + 1] = bins.edges[i];
+      x[3 * i + 2] = x[3 * i + 3] = bins.edges[i + 1];
+      y[3 * i + 1] = y[3 * i + 2] = bins.counts[i];
+      y[3 * i + 3] = 0;
+    }
+  }
+
+  /* _binSamples(): counts the samples of x that fall in each of bins.
+   * Evenly spaced bins are found HISTOGRAM_PACKET samples at a time, with
+   * packed float instructions; other bins by a binary search over the
+   * edges. Samples out of the edges, or NaN, go to an extra bin that's
+   * dropped at the end, which keeps the counting loop free of branches.
+   */
+  static void _binSamples(const HistogramBins &bins, const Eigen::ArrayXf &x,
+                          std::vector<quint32> &counts) {
+    typedef Eigen::Array<float, HISTOGRAM_PACKET, 1> Packet;
+    typedef Eigen::Array<int, HISTOGRAM_PACKET, 1> PacketIndex;
+
+    const int n = bins.counts.size();
+    const float *xs = x.data();
+
+    // The samples are floats: they are compared to the edges rounded to
+    // floats too, or a sample equal to the first edge could fall before it.
+    std::vector<float> rounded(bins.edges.begin(), bins.edges.end());
+    const float *edges = rounded.data();
+    const float lo = edges[0], hi = edges[n];
+    const float scale = n / (hi - lo);
+
+    // t, the product, may be rounded into a neighbor bin when it's close
+    // to an edge. The edges themselves tell then.
+    auto fixBin = [=](float v, float t, int bin) {
+      const float f = t - bin;
+      if (bin < n && (f < 1e-3f || f > 1 - 1e-3f)) {
+        bin -= (v < edges[bin]);
+        bin += (bin < n - 1) & (v >= edges[bin + 1]);
+      }
+      return qBound(0, bin, n);
+    };
+
+    _parallelCount(counts, n + 1, x.rows(), [&](quint32 *grid, int begin,
+                                                int end) {
+      int i = begin;
+      if (bins.uniform) {
+        for (; i + HISTOGRAM_PACKET <= end; i += HISTOGRAM_PACKET) {
+          const Eigen::Map<const Packet> v(xs + i);
+          const Packet t = (v - lo) * scale;
+          const PacketIndex index = (v >= lo && v <= hi)
+                                        .select(t.min(float(n - 1)), float(n))
+                                        .template cast<int>();
+          for (int k = 0; k < HISTOGRAM_PACKET; k++)
+            grid[fixBin(v.coeff(k), t.coeff(k), index.coeff(k))]++;
+        }
+      }
+
+      for (; i < end; i++) {
+        const float v = xs[i];
+        int bin = n;
+        if (v >= lo && v <= hi)
+          bin = bins.uniform
+                    ? fixBin(v, (v - lo) * scale,
+                             std::min(int((v - lo) * scale), n - 1))
+                    : qBound(0,
+                             int(std::upper_bound(edges, edges + n + 1, v) -
+                                 edges) - 1,
+                             n - 1);
+        grid[bin]++;
+      }
+    });
+    counts.pop_back(); // out of the edges
+  }
+
+  /* _parallelCount(): counts the samples 0..n-1 into bins, through
+   * countRange(grid, begin, end), which adds the samples from begin to end
+   * to grid. Big inputs are split among threads, each counting into a grid
+   * of its own, and the grids are then summed. Returns the highest count.
+   */
+  template <class CountRange>
+  static quint32 _parallelCount(std::vector<quint32> &counts, int bins, int n,
+                                const CountRange &countRange) {
+    const int threads =
+        std::max(1, std::min(QThread::idealThreadCount(),
+                             n / BINNING_POINTS_PER_THREAD));
+
+    counts.assign(bins, 0);
+    std::vector<std::vector<quint32>> partial(threads - 1);
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) {
+      partial[t - 1].assign(bins, 0);
+      pool.emplace_back(std::cref(countRange), partial[t - 1].data(),
+                        qint64(n) * t / threads, qint64(n) * (t + 1) / threads);
+    }
+    countRange(counts.data(), 0, n / threads);
+    for (std::thread &t : pool)
+      t.join();
+
+    quint32 peak = 0;
+    for (int i = 0; i < bins; i++) {
+      quint32 c = counts[i];
+      for (const std::vector<quint32> &grid : partial)
+        c += grid[i];
+      counts[i] = c;
+      peak = std::max(peak, c);
+    }
+    return peak;
+  }
+
+  /* _countBins(): counts how many of the samples 0..n-1 binOf() puts in each
+   * of the bins, a bin of -1 meaning none. Returns the highest count.
+   */
+  template <class BinOf>
+  static quint32 _countBins(std::vector<quint32> &counts, int bins, int n,
+                            const BinOf &binOf) {
+    return _parallelCount(counts, bins, n,
+                          [&binOf](quint32 *grid, int begin, int end) {
+                            for (int i = begin; i < end; i++) {
+                              const int bin = binOf(i);
+                              if (bin >= 0)
+                                grid[bin]++;
+                            }
+                          });
+  }
+
+  /* _countDensity(): counts the points falling on each pixel of a width x
+   * height image of [xMin, xMax] x [yMin, yMax]. Returns the highest count.
+   */
+  static quint32 _countDensity(std::vector<quint32> &counts,
+                               const QVector<QPointF> &points, int width,
+                               int height, qreal xMin, qreal xMax, qreal yMin,
+                               qreal yMax) {
+    const qreal sx = (xMax > xMin) ? width / (xMax - xMin) : 0;
+    const qreal sy = (yMax > yMin) ? height / (yMax - yMin) : 0;
+    const QPointF *p = points.constData();
+
+    return _countBins(counts, width * height, points.size(), [=](int i) {
+      const qreal px = (p[i].x() - xMin) * sx;
+      const qreal py = (yMax - p[i].y()) * sy;
+      // also false for NaN
+      if (px >= 0 && px < width && py >= 0 && py < height)
+        return int(py) * width + int(px);
+      return -1;
+    });
+  }
+
+  /* _blendDensity(): paints color over image, with an opacity that grows
+   * with the log of counts, so sparse points stay visible next to dense
+   * clusters.
+   */
+  static void _blendDensity(QImage &image, const std::vector<quint32> &counts,
+                            quint32 peak, const QColor &color) {
+    if (peak == 0)
+      return;
+
+    const int width = image.width();
+    const float scale = color.alphaF() / std::log1p(float(peak));
+    for (int y = 0; y < image.height(); y++) {
+      QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+      const quint32 *c = counts.data() + y * width;
+      for (int x = 0; x < width; x++) {
+        if (!c[x])
+          continue;
+
+        // source over, premultiplied
+        const float a = std::log1p(float(c[x])) * scale;
+        const float keep = 1 - a;
+        const QRgb dst = line[x];
+        line[x] = qRgba(int(color.red() * a + qRed(dst) * keep),
+                        int(color.green() * a + qGreen(dst) * keep),
+                        int(color.blue() * a + qBlue(dst) * keep),
+                        int(255 * a + qAlpha(dst) * keep));
+      }
+    }
+  }
+
+  /* _histogram2D(): bins the points (x, y) for hist2d() or hexbin(). The
+   * bins span the bounds of the data: bins x bins rectangles, or hexagons
+   * bins wide and as many high as it takes for them to be regular.
+   */
+  void _histogram2D(const Eigen::ArrayXf &x, const Eigen::ArrayXf &y,
+                    int bins, const QString &cmap, bool hexagonal) {
+    const char *name = hexagonal ? "hexbin()" : "hist2d()";
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << name << ": sz=" << x.rows() << " bins=" << bins
+             << " cmap=" << cmap;
+#endif
+    if (x.rows() != y.rows()) {
+      qCritical() << name << "!!! x.sz=" << x.rows() << " != y.sz=" << y.rows();
+      exit(-1);
+    }
+
+    if (bins <= 0) {
+      qCritical() << name << "!!! bins must be > 0 but it is" << bins;
+      return;
+    }
+
+    ImageData hist;
+    hist.colormap = _colormap(cmap);
+    if (hist.colormap.isEmpty()) {
+      qCritical() << name << "!!! unknown colormap" << cmap;
+      return;
+    }
+
+    qreal xMin, xMax, yMin, yMax;
+    _minMax<float, float>(x, y, xMin, xMax, yMin, yMax);
+    if (xMin > xMax || yMin > yMax) {
+      qCritical() << name << "!!! there are no points to bin.";
+      return;
+    }
+
+    // a flat input still needs bins with some width
+    if (xMin == xMax)
+      xMin -= 0.5, xMax += 0.5;
+    if (yMin == yMax)
+      yMin -= 0.5, yMax += 0.5;
+
+    const int nx = bins;
+    const int ny = hexagonal ? std::max(1, int(bins / std::sqrt(3.0))) : bins;
+    const qreal sx = nx / (xMax - xMin);
+    const qreal sy = ny / (yMax - yMin);
+    const float *xs = x.data();
+    const float *ys = y.data();
+
+    if (!hexagonal) {
+      hist.peak = _countBins(hist.counts, nx * ny, x.rows(), [=](int i) {
+        const qreal px = (xs[i] - xMin) * sx;
+        const qreal py = (ys[i] - yMin) * sy;
+        // also false for NaN
+        if (!(px >= 0 && px <= nx && py >= 0 && py <= ny))
+          return -1;
+        return std::min(int(py), ny - 1) * nx + std::min(int(px), nx - 1);
+      });
+    } else {
+      // the centers of the hexagons form two lattices, the second shifted by
+      // half a cell. A point goes to the nearest center, with y distances
+      // weighted so that cells sy/sx = sqrt(3) apart are regular hexagons.
+      const int first = (nx + 1) * (ny + 1);
+      hist.peak =
+          _countBins(hist.counts, first + nx * ny, x.rows(), [=](int i) {
+            const qreal px = (xs[i] - xMin) * sx;
+            const qreal py = (ys[i] - yMin) * sy;
+            if (!(px >= 0 && px <= nx && py >= 0 && py <= ny))
+              return -1;
+
+            const int ix1 = qRound(px), iy1 = qRound(py);
+            const int ix2 = std::min(int(px), nx - 1);
+            const int iy2 = std::min(int(py), ny - 1);
+            const qreal d1 = (px - ix1) * (px - ix1) + 3 * (py - iy1) * (py - iy1);
+            const qreal d2 = (px - ix2 - 0.5) * (px - ix2 - 0.5) +
+                             3 * (py - iy2 - 0.5) * (py - iy2 - 0.5);
+            return d1 <= d2 ? iy1 * (nx + 1) + ix1 : first + iy2 * nx + ix2;
+          });
+    }
+
+    hist.hexagonal = hexagonal;
+    hist.nx = nx;
+    hist.ny = ny;
+    hist.extent[0] = xMin;
+    hist.extent[1] = xMax;
+    hist.extent[2] = yMin;
+    hist.extent[3] = yMax;
+
+    // rectangles are drawn as an image of one pixel per bin, stretched
+    if (!hexagonal) {
+      hist.image = QImage(nx, ny, QImage::Format_ARGB32_Premultiplied);
+      for (int j = 0; j < ny; j++) {
+        QRgb *line = reinterpret_cast<QRgb *>(hist.image.scanLine(ny - 1 - j));
+        const quint32 *c = hist.counts.data() + j * nx;
+        for (int i = 0; i < nx; i++)
+          line[i] = hist.colormap[_colorIndex(c[i], hist.peak)];
+      }
+    }
+
+    FigureEdit edit(this);
+    _images.append(hist);
+    _plotAreaDirty = true;
+  }
+
+  /* _paintImage(): paints hist on the image of the plot area.
+   * toPixel maps chart values to the pixels of painter.
+   */
+  static void _paintImage(QPainter &painter, const ImageData &hist,
+                          const QTransform &toPixel) {
+    const qreal *e = hist.extent;
+    if (!hist.hexagonal) {
+      // scaled without smoothing, so every pixel keeps a single color
+      painter.drawImage(
+          toPixel.mapRect(QRectF(QPointF(e[0], e[2]), QPointF(e[1], e[3]))),
+          hist.image);
+      return;
+    }
+
+    const int nx = hist.nx;
+    const qreal sx = (e[1] - e[0]) / nx;
+    const qreal sy = (e[3] - e[2]) / hist.ny;
+    QPolygonF hexagon;
+    hexagon << QPointF(0.5 * sx, -sy / 6) << QPointF(0.5 * sx, sy / 6)
+            << QPointF(0, sy / 3) << QPointF(-0.5 * sx, sy / 6)
+            << QPointF(-0.5 * sx, -sy / 6) << QPointF(0, -sy / 3);
+
+    painter.setPen(Qt::NoPen);
+    const int first = (nx + 1) * (hist.ny + 1);
+    for (int k = 0; k < int(hist.counts.size()); k++) {
+      const bool shifted = (k >= first);
+      const int cell = shifted ? k - first : k;
+      const int columns = shifted ? nx : nx + 1;
+      const qreal offset = shifted ? 0.5 : 0;
+      const QPointF center(e[0] + (cell % columns + offset) * sx,
+                           e[2] + (cell / columns + offset) * sy);
+
+      painter.setBrush(QColor::fromRgba(
+          hist.colormap[_colorIndex(hist.counts[k], hist.peak)]));
+      painter.drawPolygon(toPixel.map(hexagon.translated(center)));
+    }
+  }
+
+  /* _applyColormap(): colors the rows x cols values of z into image, with
+   * the last row at the top. outerStride is the distance between the rows
+   * of z if rowMajor, between its columns otherwise. lut holds the 256
+   * colors from vmin to vmax, then the one of NaN.
+   * The rows of a row major z are colored straight into the scanlines. A
+   * column major z is colored a tile at a time: COLORMAP_TILE_ROWS values
+   * down each column, for COLORMAP_TILE_COLS columns, into a block small
+   * enough to stay in cache, whose rows are then copied to the scanlines.
+   * Rows, or rows of tiles, are shared among threads.
+   */
+  static void _applyColormap(QImage &image, const float *z, int rows,
+                             int cols, qint64 outerStride, bool rowMajor,
+                             const QVector<QRgb> &lut, float vmin,
+                             float vmax) {
+    const float scale = (vmax > vmin) ? 255 / (vmax - vmin) : 0;
+    const QRgb *colors = lut.constData();
+    uchar *bits = image.bits();
+    const int stride = image.bytesPerLine();
+    auto scanLine = [=](int row) {
+      return reinterpret_cast<QRgb *>(bits + qint64(rows - 1 - row) * stride);
+    };
+
+    auto band = [=](int first, int last) {
+      if (rowMajor) {
+        for (int r = first; r < last; r++)
+          _colorRun(z + r * outerStride, cols, scanLine(r), 1, colors, vmin,
+                    scale);
+        return;
+      }
+
+      QRgb block[COLORMAP_TILE_ROWS * COLORMAP_TILE_COLS];
+      for (int r0 = first * COLORMAP_TILE_ROWS;
+           r0 < std::min(rows, last * COLORMAP_TILE_ROWS);
+           r0 += COLORMAP_TILE_ROWS) {
+        const int n = std::min(COLORMAP_TILE_ROWS, rows - r0);
+        for (int c0 = 0; c0 < cols; c0 += COLORMAP_TILE_COLS) {
+          const int m = std::min(COLORMAP_TILE_COLS, cols - c0);
+          for (int c = 0; c < m; c++)
+            _colorRun(z + (c0 + c) * outerStride + r0, n, block + c,
+                      COLORMAP_TILE_COLS, colors, vmin, scale);
+
+          for (int k = 0; k < n; k++) {
+            const QRgb *src = block + k * COLORMAP_TILE_COLS;
+            std::copy(src, src + m, scanLine(r0 + k) + c0);
+          }
+        }
+      }
+    };
+
+    const int units =
+        rowMajor ? rows : (rows + COLORMAP_TILE_ROWS - 1) / COLORMAP_TILE_ROWS;
+    const int threads = std::max(
+        1, std::min({QThread::idealThreadCount(), units,
+                     int(qint64(rows) * cols / COLORMAP_PIXELS_PER_THREAD)}));
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+      pool.emplace_back(band, units * t / threads, units * (t + 1) / threads);
+    band(0, units / threads);
+    for (std::thread &t : pool)
+      t.join();
+  }
+
+  /* _colorRun(): writes the colors of the n values of v, one every step
+   * QRgb of out. The values are normalized COLORMAP_PACKET at a time, with
+   * packed float instructions, into indices of colors.
+   */
+  static void _colorRun(const float *v, int n, QRgb *out, int step,
+                        const QRgb *colors, float vmin, float scale) {
+    typedef Eigen::Array<float, COLORMAP_PACKET, 1> Packet;
+    typedef Eigen::Array<int, COLORMAP_PACKET, 1> PacketIndex;
+
+    int i = 0;
+    for (; i + COLORMAP_PACKET <= n; i += COLORMAP_PACKET) {
+      // NaN fails v == v, it gets the color after the colormap
+      const Eigen::Map<const Packet> values(v + i);
+      const PacketIndex index =
+          (values == values)
+              .select(((values - vmin) * scale).max(0.f).min(255.f), 256.f)
+              .template cast<int>();
+      for (int k = 0; k < COLORMAP_PACKET; k++)
+        out[(i + k) * step] = colors[index.coeff(k)];
+    }
+
+    for (; i < n; i++) {
+      const float t = (v[i] - vmin) * scale;
+      out[i * step] =
+          colors[v[i] != v[i] ? 256 : int(t < 0 ? 0 : (t > 255 ? 255 : t))];
+    }
+  }
+
+  /* _colorIndex(): the entry of a 256 color colormap for count. */
+  static int _colorIndex(quint32 count, quint32 peak) {
+    return peak ? int(quint64(count) * 255 / peak) : 0;
+  }
+
+  /* _colormap(): the 256 colors of the colormap called name, from the
+   * lowest value to the highest. Empty if there's no such colormap.
+   */
+  static QVector<QRgb> _colormap(const QString &name) {
+    struct Colormap {
+      const char *name;
+      int size;
+      QRgb anchors[10]; // evenly spaced, linearly interpolated
+    };
+    static const Colormap colormaps[] = {
+        {"viridis",
+         10,
+         {0x440154, 0x482878, 0x3e4989, 0x31688e, 0x26828e, 0x1f9e89,
+          0x35b779, 0x6ece58, 0xb5de2b, 0xfde725}},
+        {"plasma",
+         10,
+         {0x0d0887, 0x46039f, 0x7201a8, 0x9c179e, 0xbd3786, 0xd8576b,
+          0xed7953, 0xfb9f3a, 0xfdca26, 0xf0f921}},
+        {"hot", 4, {0x0b0000, 0xff0000, 0xffff00, 0xffffff}},
+        {"gray", 2, {0x000000, 0xffffff}},
+        {"grey", 2, {0x000000, 0xffffff}}};
+
+    QVector<QRgb> colors;
+    for (const Colormap &map : colormaps) {
+      if (name != map.name)
+        continue;
+
+      colors.resize(256);
+      for (int k = 0; k < 256; k++) {
+        const qreal t = k * (map.size - 1) / 255.0;
+        const int i = std::min(int(t), map.size - 2);
+        const qreal f = t - i;
+        const QRgb a = map.anchors[i], b = map.anchors[i + 1];
+        colors[k] = qRgb(qRound(qRed(a) + (qRed(b) - qRed(a)) * f),
+                         qRound(qGreen(a) + (qGreen(b) - qGreen(a)) * f),
+                         qRound(qBlue(a) + (qBlue(b) - qBlue(a)) * f));
+      }
+      break;
+    }
+    return colors;
+  }
+
+
+  /* _updateAxis(): brings an axis of the chart up to date. The axis is only
+   * created again when it switches between values and user defined ticks,
+   * its settings are only applied when dirty, and its range when it moved.
+   * nice: min and max are rounded to nice numbers, unless the axis has
+   * user defined ticks. shown holds the range last given to the axis.
+   * Returns true if the series must be attached to a new axis.
+   */
+  bool _updateAxis(QtCharts::QAbstractAxis *&axis, Qt::Alignment alignment,
+                   int show, const QVector<QPair<QString, qreal>> &ticks,
+                   const QString &label, int tickCount, qreal min, qreal max,
+                   bool nice, bool dirty, qreal *shown) {
+    const bool custom = (show == SHOW_CUSTOM_TICK);
+    bool created = false;
+    if (axis && custom != (axis->type() ==
+                           QtCharts::QAbstractAxis::AxisTypeCategory)) {
+      _chart->removeAxis(axis);
+      delete axis;
+      axis = NULL;
+    }
+
+    if (!axis) {
+      if (custom)
+        axis = new QtCharts::QCategoryAxis();
+      else
+        axis = new QtCharts::QValueAxis();
+      _chart->addAxis(axis, alignment);
+      created = dirty = true;
+    }
+
+    // both kinds of axis are value axes
+    QtCharts::QValueAxis *values = static_cast<QtCharts::QValueAxis *>(axis);
+
+    if (dirty) {
+      QPen axisPen(Qt::black); // default axis line color and width
+      axisPen.setWidth(1);
+      axis->setGridLineVisible(_enableGrid);
+      axis->setLinePen(axisPen);
+
+      if (custom) {
+        QtCharts::QCategoryAxis *categories =
+            static_cast<QtCharts::QCategoryAxis *>(axis);
+        for (const QString &category : categories->categoriesLabels())
+          categories->remove(category);
+
+        for (int i = 0; i < ticks.size(); i++) {
+#if (DEBUG > 1) && (DEBUG < 3)
+          qDebug() << "_updateAxis(): tick[" << i << "]=(" << ticks[i].second
+                   << " , " << ticks[i].first << ")";
 #endif
+          categories->append(ticks[i].first, ticks[i].second);
+        }
+        values->setTickCount(ticks.size());
+      } else {
+        axis->setTitleText(label);
+        axis->setLabelsVisible(show != HIDE_TICK);
+        values->setTickCount(tickCount);
+      }
+    }
+
+    if (dirty || shown[0] != min || shown[1] != max) {
+      values->setRange(min, max);
+      if (!custom && nice)
+        values->applyNiceNumbers();
+      shown[0] = min;
+      shown[1] = max;
+    }
+
+    return created;
+  }
+
+  /* _minMax(): finds the bounds of x and y in a single pass over both.
+   * NaNs are skipped. The work is spread over independent lanes so that the
+   * compiler turns the loop into packed min/max instructions of the type of
+   * the samples. The bounds of an empty or all-NaN input are +inf/-inf.
+   */
+  template <class Tx, class Ty>
+  static void _minMax(const SampleRef<Tx> &x, const SampleRef<Ty> &y,
+                      qreal &xMin, qreal &xMax, qreal &yMin, qreal &yMax) {
+    const qreal inf = std::numeric_limits<qreal>::infinity();
+    xMin = yMin = inf;
+    xMax = yMax = -inf;
+
+    const int n = x.rows();
+    const int lanes = 8;
+    const Tx *xs = x.data();
+    const Ty *ys = y.data();
+    Tx x0[lanes], x1[lanes];
+    Ty y0[lanes], y1[lanes];
+    for (int k = 0; k < lanes; k++) {
+      x0[k] = _highest<Tx>();
+      x1[k] = _lowest<Tx>();
+      y0[k] = _highest<Ty>();
+      y1[k] = _lowest<Ty>();
+    }
+
+    // comparisons with NaN are false, so NaNs never replace a bound
+    int i = 0;
+    for (; i + lanes <= n; i += lanes) {
+      for (int k = 0; k < lanes; k++) {
+        const Tx vx = xs[i + k];
+        const Ty vy = ys[i + k];
+        x0[k] = vx < x0[k] ? vx : x0[k];
+        x1[k] = vx > x1[k] ? vx : x1[k];
+        y0[k] = vy < y0[k] ? vy : y0[k];
+        y1[k] = vy > y1[k] ? vy : y1[k];
+      }
+    }
+
+    for (; i < n; i++) {
+      const Tx vx = xs[i];
+      const Ty vy = ys[i];
+      x0[0] = vx < x0[0] ? vx : x0[0];
+      x1[0] = vx > x1[0] ? vx : x1[0];
+      y0[0] = vy < y0[0] ? vy : y0[0];
+      y1[0] = vy > y1[0] ? vy : y1[0];
+    }
+
+    for (int k = 0; k < lanes; k++) {
+      xMin = std::min<qreal>(xMin, x0[k]);
+      xMax = std::max<qreal>(xMax, x1[k]);
+      yMin = std::min<qreal>(yMin, y0[k]);
+      yMax = std::max<qreal>(yMax, y1[k]);
+    }
+  }
+
+  /* _minMax(): same as above, for the samples of a single axis.
+   */
+  template <class T>
+  static void _minMax(const SampleRef<T> &v, qreal &vMin, qreal &vMax) {
+    const int lanes = 8;
+    const int n = v.rows();
+    const T *vs = v.data();
+    T v0[lanes], v1[lanes];
+    for (int k = 0; k < lanes; k++) {
+      v0[k] = _highest<T>();
+      v1[k] = _lowest<T>();
+    }
+
+    int i = 0;
+    for (; i + lanes <= n; i += lanes) {
+      for (int k = 0; k < lanes; k++) {
+        const T value = vs[i + k];
+        v0[k] = value < v0[k] ? value : v0[k];
+        v1[k] = value > v1[k] ? value : v1[k];
+      }
+    }
+
+    for (; i < n; i++) {
+      v0[0] = vs[i] < v0[0] ? vs[i] : v0[0];
+      v1[0] = vs[i] > v1[0] ? vs[i] : v1[0];
+    }
+
+    vMin = std::numeric_limits<qreal>::infinity();
+    vMax = -vMin;
+    for (int k = 0; k < lanes; k++) {
+      vMin = std::min<qreal>(vMin, v0[k]);
+      vMax = std::max<qreal>(vMax, v1[k]);
+    }
   }
 
-  /* yticks(): sets the y-limits of the current tick locations and labels.
+  /* _highest(), _lowest(): +inf and -inf, or the limits of integer types.
    */
-  void yticks(const Eigen::ArrayXf &values, const QVector<QString> &labels) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "yticks(): values.sz=" << values.rows()
-             << " labels.sz=" << labels.size();
-#endif
-    if (values.rows() == 0 && labels.size() == 0) {
-      _showYticks = HIDE_TICK;
+  template <class T> static T _highest() {
+    return std::numeric_limits<T>::has_infinity
+               ? std::numeric_limits<T>::infinity()
+               : std::numeric_limits<T>::max();
+  }
+
+  template <class T> static T _lowest() {
+    return std::numeric_limits<T>::has_infinity
+               ? -std::numeric_limits<T>::infinity()
+               : std::numeric_limits<T>::lowest();
+  }
+
+  /* _growLimits(): limits set by xlim(), ylim() or axis() still grow to fit
+   * the data plotted after them. Otherwise _autoscale() takes care of it.
+   */
+  void _growLimits(qreal xMin, qreal xMax, qreal yMin, qreal yMax) {
+    if (!_customLimits)
       return;
-    }
 
-    if (values.rows() != labels.size()) {
-      qCritical()
-          << "PlotLib::xticks(): the amount of values and labels must match!";
+    if (xMin < _xMin)
+      _xMin = xMin;
+    if (xMax > _xMax)
+      _xMax = xMax;
+    if (yMin < _yMin)
+      _yMin = yMin;
+    if (yMax > _yMax)
+      _yMax = yMax;
+  }
+
+  /* _autoscale(): unless the user defined the limits, the axis span the
+   * union of the bounds cached by every series, and 0, like the limits
+   * always did. A series that dropped samples since the last call joins the
+   * bounds of the blocks of its ring buffer, its samples aren't read again.
+   */
+  void _autoscale() {
+    if (_customLimits)
       return;
+
+    qreal xMin = 0, xMax = 0, yMin = 0, yMax = 0;
+    for (SeriesData &data : _seriesVec) {
+      if (data.boundsStale) {
+        // a ring buffer that dropped samples is full: every block counts
+        if (data.uniform) {
+          _uniformBounds(data.x0 + data.dx * data.start, data.dx, data.count,
+                         data.xMin, data.xMax);
+        } else {
+          data.xMin = data.blocks.row(0).minCoeff();
+          data.xMax = data.blocks.row(1).maxCoeff();
+        }
+        data.yMin = data.blocks.row(2).minCoeff();
+        data.yMax = data.blocks.row(3).maxCoeff();
+        data.boundsStale = false;
+      }
+
+      xMin = std::min(xMin, data.xMin);
+      xMax = std::max(xMax, data.xMax);
+      yMin = std::min(yMin, data.yMin);
+      yMax = std::max(yMax, data.yMax);
     }
 
-    for (int i = 0; i < values.rows(); i++)
-      _yTicks.push_back(QPair<QString, qreal>(labels[i], values[i]));
+    for (const ImageData &hist : _images) {
+      xMin = std::min(xMin, hist.extent[0]);
+      xMax = std::max(xMax, hist.extent[1]);
+      yMin = std::min(yMin, hist.extent[2]);
+      yMax = std::max(yMax, hist.extent[3]);
+    }
 
-    _showYticks = SHOW_CUSTOM_TICK;
+    // all the samples are 0, or there's no data at all
+    if (xMin == xMax)
+      xMin -= 0.5, xMax += 0.5;
+    if (yMin == yMax)
+      yMin -= 0.5, yMax += 0.5;
+
+    _xMin = xMin;
+    _xMax = xMax;
+    _yMin = yMin;
+    _yMax = yMax;
+  }
+
+  /* _samples(): Eigen data is used as is, containers of numbers are mapped
+   * in place as an Eigen array.
+   */
+  template <class D>
+  static const D &_samples(const Eigen::DenseBase<D> &d) {
+    return d.derived();
+  }
+
+  template <class T>
+  static Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, 1>>
+  _samples(const std::vector<T> &v) {
+    return Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, 1>>(v.data(),
+                                                                v.size());
+  }
+
+  template <class T>
+  static Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, 1>>
+  _samples(const QVector<T> &v) {
+    return Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, 1>>(v.constData(),
+                                                                v.size());
+  }
+
+  /* _asArray(): matrices and vectors are plotted through their array view.
+   */
+  template <class D>
+  static const D &_asArray(const Eigen::ArrayBase<D> &a) {
+    return a.derived();
+  }
+
+  template <class D>
+  static const Eigen::ArrayWrapper<const D> _asArray(const Eigen::MatrixBase<D> &m) {
+    return m.array();
+  }
+
+  /* _fillPoints(): interleaves x and y into a buffer of QPointF in one pass.
+   * QPointF is a pair of qreals, so the buffer is written through a plain
+   * qreal pointer which lets the compiler vectorize the conversion of the
+   * samples, whatever their type, to qreal.
+   */
+  template <class Tx, class Ty>
+  static void _fillPoints(QVector<QPointF> &points, const SampleRef<Tx> &x,
+                          const SampleRef<Ty> &y) {
+    points.resize(x.rows());
+    _fillPoints<Tx, Ty>(points.data(), x, y);
+  }
+
+  template <class Tx, class Ty>
+  static void _fillPoints(QPointF *points, const SampleRef<Tx> &x,
+                          const SampleRef<Ty> &y) {
+    static_assert(sizeof(QPointF) == 2 * sizeof(qreal),
+                  "QPointF is expected to be made of two packed qreals");
+
+    const int n = x.rows();
+    qreal *dst = reinterpret_cast<qreal *>(points);
+    const Tx *xs = x.data();
+    const Ty *ys = y.data();
+    for (int i = 0; i < n; i++) {
+      dst[2 * i] = xs[i];
+      dst[2 * i + 1] = ys[i];
+    }
+  }
+
+  /* _decimate(): line series may be decimated since the chart can't display
+   * more than a few points per pixel column anyway. Scatter plots are not
+   * decimated: every marker is visible on its own. Unbounded series are
+   * decimated from the samples they keep, bounded series can't keep a LOD
+   * index and fall back to "m4". Returns false when the points of data were
+   * left untouched.
+   */
+  template <class Dx, class Dy>
+  bool _decimate(SeriesData &data, const Eigen::ArrayBase<Dx> &x,
+                 const Eigen::ArrayBase<Dy> &y, qreal xMin, qreal xMax) {
+    const PlotOptions::Decimation decimate = data.decimate;
+    QVector<QPointF> &points = data.points;
+    if (decimate == PlotOptions::DecimateNone || data.isScatter ||
+        x.rows() <= 4 * _width)
+      return false;
+
+    // when xlim() is active, spend the pixel columns on the visible range
+    qreal lo = _customLimits ? _xMin : xMin;
+    qreal hi = _customLimits ? _xMax : xMax;
+    if (decimate == PlotOptions::DecimateLTTB && !_keepsSamples(data))
+      _decimateLTTB(points, x, y, 4 * _width);
+    else if (decimate == PlotOptions::DecimateLOD && data.capacity == 0) {
+      _indexLod(data, x, y);
+      _queryLod(data, lo, hi);
+    } else if (_keepsSamples(data))
+      _decimateSamples(data, lo, hi);
+    else
+      _decimateM4(points, x, y, lo, hi, _width);
 
 #if (DEBUG > 1) && (DEBUG < 3)
-    qDebug() << "yticks(): yticks.sz=" << _yTicks.size();
-    for (int i = 0; i < _yTicks.size(); i++)
-      qDebug() << "\t" << _yTicks[i].second << " = " << _yTicks[i].first;
+    qDebug() << "_decimate(): decimated" << x.rows() << "points to"
+             << points.size();
 #endif
+    return true;
   }
 
-  /* locator_params(): reduce or increase the amount of ticks for each axis.
+  /* _keepsSamples(): unbounded series decimated with "m4" or "lttb" keep
+   * their samples in x and y, like append() does, so that appended samples
+   * and new ranges of the axis are decimated from the full data.
    */
-  void locator_params(QString axis, int nbins) {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "locator_params(): axis=" << axis << " nbins=" << nbins;
-#endif
-    if (axis == "x") {
-      _xTickCount = nbins;
-    } else if (axis == "y") {
-      _yTickCount = nbins;
-    } else if (axis == "both") {
-      _yTickCount = _xTickCount = nbins;
-    } else {
-      qCritical() << "locator_params(): '" << axis
-                  << "' is not a valid option.";
+  static bool _keepsSamples(const SeriesData &data) {
+    return data.capacity == 0 && !data.isScatter &&
+           (data.decimate == PlotOptions::DecimateM4 ||
+            data.decimate == PlotOptions::DecimateLTTB);
+  }
+
+  /* _decimateSamples(): makes the points of a series that keeps its samples
+   * for the x range lo..hi. "m4" reduces every pixel column of the range,
+   * "lttb" the samples from the first to the last one inside the range.
+   */
+  void _decimateSamples(SeriesData &data, qreal lo, qreal hi) {
+    QVector<QPointF> &points = data.points;
+    data.decimated[0] = lo;
+    data.decimated[1] = hi;
+    const int n = data.count;
+    const qreal x0 = data.x0 + data.dx * data.start;
+    if (n <= 4 * _width) {
+      points.resize(n);
+      if (data.uniform)
+        _fillUniform<float>(points.data(), x0, data.dx, data.y.head(n));
+      else
+        _fillPoints<float, float>(points.data(), data.x.head(n),
+                                  data.y.head(n));
+      return;
+    }
+
+    if (!(hi > lo)) {
+      lo = data.xMin;
+      hi = data.xMax;
+    }
+
+    // x of a series sampled at a fixed step is computed on the fly
+    if (data.uniform)
+      _decimateSamples(
+          data, Eigen::ArrayXd::LinSpaced(n, x0, x0 + data.dx * (n - 1)), lo,
+          hi);
+    else
+      _decimateSamples(data, data.x.head(n), lo, hi);
+  }
+
+  template <class Dx>
+  void _decimateSamples(SeriesData &data, const Eigen::ArrayBase<Dx> &x,
+                        qreal lo, qreal hi) {
+    const int n = data.count;
+    if (data.decimate == PlotOptions::DecimateM4) {
+      _decimateM4(data.points, x, data.y.head(n), lo, hi, _width);
       return;
     }
+
+    // one more sample on each side, so the line leaves the chart at its edges
+    int first = 0, last = n - 1;
+    while (first < n && !(x[first] >= lo && x[first] <= hi))
+      first++;
+    while (last > first && !(x[last] >= lo && x[last] <= hi))
+      last--;
+    if (first == n) {
+      first = 0;
+      last = n - 1;
+    }
+    first = std::max(0, first - 1);
+    last = std::min(n - 1, last + 1);
+    _decimateLTTB(data.points, x.segment(first, last - first + 1),
+                  data.y.segment(first, last - first + 1), 4 * _width);
   }
 
-  template <class T, class... Args>
-  typename std::enable_if<!is_matrix_expression<T>::value>::type
-  plot(const Eigen::ArrayXf &y, const T &arg1, const Args &...args) {
+  /* _checkLod(): a LOD index needs x to be increasing. Otherwise the series
+   * is decimated with "m4" instead, and keeps its samples like any other
+   * series decimated with "m4".
+   */
+  template <class Dx>
+  static void _checkLod(SeriesData &data, const Eigen::ArrayBase<Dx> &x) {
+    if (data.decimate != PlotOptions::DecimateLOD || data.capacity > 0)
+      return;
+
+    bool increasing = !data.uniform || data.dx > 0;
+    for (int i = 1; increasing && !data.uniform && i < x.rows(); i++)
+      increasing = x[i - 1] <= x[i];
+
+    if (!increasing) {
 #if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "plot(y): marker=" << marker << " alpha=" << alpha
-             << " color=" << color << " edgecolor=" << edgecolor
-             << " linewidth=" << linewidth << " markersize=" << markersize;
+      qDebug() << "_checkLod(): x isn't increasing, decimating with m4";
 #endif
-    if (y.rows() == 0) {
-      qCritical() << "plot(y): axis size must be > 0 but its " << y.rows();
-      exit(-1);
+      data.decimate = PlotOptions::DecimateM4;
     }
+  }
 
-    // number of x values needed to accompany the y values
-    int num_items = y.rows();
+  /* _indexLod(): copies the samples of a series decimated with "lod" into a
+   * new LOD index, built in a single pass. x was found to be increasing by
+   * _checkLod().
+   */
+  template <class Dx, class Dy>
+  static void _indexLod(SeriesData &data, const Eigen::ArrayBase<Dx> &x,
+                        const Eigen::ArrayBase<Dy> &y) {
+    std::shared_ptr<LodIndex> lod = std::make_shared<LodIndex>();
+    const qint64 n = y.rows();
+    if (data.uniform) {
+      lod->x0 = data.x0;
+      lod->dx = data.dx;
+    } else {
+      lod->x.resize(n);
+      Eigen::Map<Eigen::ArrayXd>(lod->x.data(), n) = x.template cast<double>();
+    }
 
-    // make up X data and plot into series, but take into account that xlim()
-    // could have been called with the start and end of x series.
-    Eigen::ArrayXf x = Eigen::ArrayXf(y.rows());
-    qreal x_inc = 1;
-    if (_customLimits && (_xMin != _xMax)) {
-      qreal xrange = _xMax - _xMin;
-      x_inc = xrange / y.rows();
+    lod->y.resize(n);
+    Eigen::Map<Eigen::ArrayXf>(lod->y.data(), n) = y.template cast<float>();
+    _extendLod(*lod, 0);
+    data.lod = lod;
+  }
+
+  /* _extendLod(): brings the levels of lod up to date with its samples from
+   * index from on. Only the blocks over these samples are computed again, so
+   * append() costs O(new samples). The first level reads every sample: big
+   * inputs are split among threads.
+   */
+  static void _extendLod(LodIndex &lod, qint64 from) {
+    const float *childMin = lod.y.data();
+    const float *childMax = lod.y.data();
+    qint64 children = lod.size();
+    for (size_t level = 0; children > 1; level++) {
+      from /= LOD_FANOUT;
+      if (level == lod.mins.size()) {
+        lod.mins.emplace_back();
+        lod.maxs.emplace_back();
+        from = 0;
+      }
+
+      std::vector<float> &mins = lod.mins[level];
+      std::vector<float> &maxs = lod.maxs[level];
+      const qint64 blocks = (children + LOD_FANOUT - 1) / LOD_FANOUT;
+      mins.resize(blocks);
+      maxs.resize(blocks);
+
+      // NaNs are skipped, a block of NaNs has the bounds +inf/-inf
+      auto reduce = [&](qint64 begin, qint64 end) {
+        for (qint64 b = begin; b < end; b++) {
+          float lo = std::numeric_limits<float>::infinity();
+          float hi = -lo;
+          const qint64 last = std::min(children, (b + 1) * LOD_FANOUT);
+          for (qint64 c = b * LOD_FANOUT; c < last; c++) {
+            lo = (childMin[c] < lo) ? childMin[c] : lo;
+            hi = (childMax[c] > hi) ? childMax[c] : hi;
+          }
+          mins[b] = lo;
+          maxs[b] = hi;
+        }
+      };
+
+      const qint64 count = blocks - from;
+      const int threads = static_cast<int>(
+          std::max<qint64>(1, std::min<qint64>(QThread::idealThreadCount(),
+                                               count * LOD_FANOUT /
+                                                   LOD_SAMPLES_PER_THREAD)));
+      std::vector<std::thread> pool;
+      for (int t = 1; t < threads; t++)
+        pool.emplace_back(std::cref(reduce), from + count * t / threads,
+                          from + count * (t + 1) / threads);
+      reduce(from, from + count / threads);
+      for (std::thread &t : pool)
+        t.join();
+
+      childMin = mins.data();
+      childMax = maxs.data();
+      children = blocks;
+    }
+  }
+
+  /* _lodBounds(): finds the bounds of the samples begin..end-1 of lod from
+   * the largest blocks that fit in the range: the blocks grow up to the
+   * middle of the range and shrink down to its end, at most LOD_FANOUT - 1
+   * of them per level each way.
+   */
+  static void _lodBounds(const LodIndex &lod, qint64 begin, qint64 end,
+                         float &lo, float &hi) {
+    lo = std::numeric_limits<float>::infinity();
+    hi = -lo;
+    size_t level = 0;
+    qint64 span = 1;
+    while (begin < end) {
+      while (level < lod.mins.size() && begin % (span * LOD_FANOUT) == 0 &&
+             begin + span * LOD_FANOUT <= end) {
+        span *= LOD_FANOUT;
+        level++;
+      }
+      while (begin + span > end) {
+        span /= LOD_FANOUT;
+        level--;
+      }
+
+      const float min = level ? lod.mins[level - 1][begin / span] : lod.y[begin];
+      const float max = level ? lod.maxs[level - 1][begin / span] : lod.y[begin];
+      lo = (min < lo) ? min : lo;
+      hi = (max > hi) ? max : hi;
+      begin += span;
+    }
+  }
+
+  /* _lodIndexOf(): index of the first sample of lod whose x is >= value.
+   */
+  static qint64 _lodIndexOf(const LodIndex &lod, qreal value) {
+    const qint64 n = lod.size();
+    if (lod.x.empty()) {
+      const qreal i = std::ceil((value - lod.x0) / lod.dx);
+      return !(i > 0) ? 0 : (i >= n ? n : static_cast<qint64>(i));
+    }
+    return std::lower_bound(lod.x.begin(), lod.x.end(), value) -
+           lod.x.begin();
+  }
+
+  /* _queryLod(): makes the points of a series with a LOD index for the x
+   * range lo..hi. When it holds more than 4 samples per pixel column, each
+   * column gets its first and last samples, and the bounds of the ones in
+   * between from the index: like "m4", in O(pixels log n) instead of O(n).
+   */
+  void _queryLod(SeriesData &data, qreal lo, qreal hi) {
+    LodIndex &lod = *data.lod;
+    QVector<QPointF> &points = data.points;
+    data.decimated[0] = lo;
+    data.decimated[1] = hi;
+
+    // one more sample on each side, so the line leaves the chart at its edges
+    const qint64 first = std::max<qint64>(0, _lodIndexOf(lod, lo) - 1);
+    const qint64 last = std::min(lod.size(), _lodIndexOf(lod, hi) + 1);
+    const int columns = _width;
+
+    points.clear();
+    if (last - first <= 4 * columns || !(hi > lo)) {
+      points.reserve(std::max<qint64>(0, last - first));
+      for (qint64 i = first; i < last; i++)
+        points.append(QPointF(lod.xAt(i), lod.y[i]));
+      return;
     }
 
-    qreal x_value = _xMin;
-    for (int i = 0; i < num_items; i++) {
-      x[i] = x_value;
-      x_value += x_inc;
+    points.reserve(4 * columns);
+    qint64 begin = first;
+    for (int c = 0; c < columns; c++) {
+      const qint64 end =
+          (c == columns - 1)
+              ? last
+              : std::max(begin, _lodIndexOf(lod, lo + (hi - lo) * (c + 1) /
+                                                         columns));
+      if (end - begin <= 4) {
+        for (qint64 i = begin; i < end; i++)
+          points.append(QPointF(lod.xAt(i), lod.y[i]));
+      } else {
+        float yMin, yMax;
+        _lodBounds(lod, begin + 1, end - 1, yMin, yMax);
+        const qreal middle = (lod.xAt(begin) + lod.xAt(end - 1)) / 2;
+        points.append(QPointF(lod.xAt(begin), lod.y[begin]));
+        if (yMin <= yMax) {
+          points.append(QPointF(middle, yMin));
+          points.append(QPointF(middle, yMax));
+        }
+        points.append(QPointF(lod.xAt(end - 1), lod.y[end - 1]));
+      }
+      begin = end;
+    }
 
 #if (DEBUG > 1) && (DEBUG < 3)
-      qDebug() << "plot(y): generated x[" << i << "]=" << x[i];
+    qDebug() << "_queryLod(): [" << lo << "," << hi << "] made"
+             << points.size() << "points out of" << lod.size();
 #endif
+  }
+
+  /* _redecimate(): makes the points of the series decimated from the
+   * samples they keep, in a LOD index or not, for the x range lo..hi, unless
+   * they already have them. Returns true if any series got new points.
+   */
+  bool _redecimate(qreal lo, qreal hi) {
+    bool changed = false;
+    for (SeriesData &data : _seriesVec) {
+      if (!(data.lod || _keepsSamples(data)) ||
+          (data.decimated[0] == lo && data.decimated[1] == hi))
+        continue;
+
+      if (data.lod)
+        _queryLod(data, lo, hi);
+      else
+        _decimateSamples(data, lo, hi);
+      data.dirty = changed = true;
     }
-    plotXY(x, y, arg1, args...);
+    return changed;
   }
 
-  /* plot(): called when user needs to put data on a chart.
-   * x: an array that stores x axis values.
-   * y: an array that stores y axis values.
-   * marker: chart types. "-" for line plot and "o" for scatter plot.
-   * alpha: defines the transparency level of the color.
-   * color: defines the color used to draw the data.
-   * edgecolor: defines the edge color of "o" marker.
-   * linewidth: defines the width of the pen used to draw "-" marker.
-   * markersize: defines the size of "o" marker.
+  /* _appendLod(): appends x and y to a LOD index. x must go on increasing:
+   * otherwise returns false and the index is left as it was.
    */
-  template <class T, class... Args>
-  typename std::enable_if<is_matrix_expression<T>::value>::type
-  plot(const Eigen::ArrayXf &x, const T &y, const Args &...args) {
-    plotXY(x, y, args...);
+  template <class Tx, class Ty>
+  static bool _appendLod(LodIndex &lod, const SampleRef<Tx> &x,
+                         const SampleRef<Ty> &y) {
+    const qint64 n = lod.size();
+    const Eigen::ArrayXd xs = x.template cast<double>();
+    if (!std::is_sorted(xs.data(), xs.data() + xs.rows()) ||
+        (n && xs.rows() && xs[0] < lod.xAt(n - 1)))
+      return false;
+
+    // x given to a series sampled at a fixed step: from now on it is stored
+    if (lod.x.empty()) {
+      lod.x.resize(n);
+      for (qint64 i = 0; i < n; i++)
+        lod.x[i] = lod.xAt(i);
+    }
+    lod.x.insert(lod.x.end(), xs.data(), xs.data() + xs.rows());
+    for (Eigen::Index i = 0; i < y.rows(); i++)
+      lod.y.push_back(y[i]);
+    _extendLod(lod, n);
+    return true;
   }
 
-  template <class... Args>
-  void plotXY(const Eigen::ArrayXf &x, const Eigen::ArrayXf &y,
-              const Args &...args) {
-    const QString marker =
-        GetKeywordInputDefault<tag::marker>(DEFAULT_MARKER, args...);
-    const QString label =
-        GetKeywordInputDefault<tag::label>(DEFAULT_LEGEND, args...);
-    const qreal &alpha =
-        GetKeywordInputDefault<tag::alpha>(DEFAULT_ALPHA, args...);
-    const QColor color =
-        GetKeywordInputDefault<tag::color>(DEFAULT_COLOR, args...);
-    const quint32 &linewidth =
-        GetKeywordInputDefault<tag::linewidth>(DEFAULT_LINEW, args...);
-    const QColor edgecolor =
-        GetKeywordInputDefault<tag::edgecolor>(DEFAULT_EDGECOLOR, args...);
-    const qreal &markersize =
-        GetKeywordInputDefault<tag::markersize>(DEFAULT_MARKERSZ, args...);
+  /* _appendLod(): same as above, for a series sampled at a fixed step.
+   */
+  template <class Ty>
+  static void _appendLod(LodIndex &lod, const SampleRef<Ty> &y) {
+    const qint64 n = lod.size();
+    for (Eigen::Index i = 0; i < y.rows(); i++)
+      lod.y.push_back(y[i]);
+    _extendLod(lod, n);
+  }
 
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "plot(x,y): marker:" << marker << " alpha:" << alpha
-             << " color:" << color << " edgecolor:" << edgecolor
-             << " linewidth:" << linewidth << " markersize:" << markersize;
+  /* _releaseLod(): hands the samples of the LOD index of data back to data
+   * and drops the index. From then on the series is decimated with "m4".
+   */
+  static void _releaseLod(SeriesData &data) {
+    const LodIndex &lod = *data.lod;
+    const int n = static_cast<int>(lod.size());
+    data.uniform = lod.x.empty();
+    if (data.uniform)
+      data.x.resize(0);
+    else
+      data.x = Eigen::Map<const Eigen::ArrayXd>(lod.x.data(), n).cast<float>();
+    data.y = Eigen::Map<const Eigen::ArrayXf>(lod.y.data(), n);
+    data.head = 0;
+    data.count = n;
+    data.start = 0;
+    data.lod.reset();
+    data.decimate = PlotOptions::DecimateM4;
+  }
+
+  /* _fillUniform(): same as _fillPoints(), with x computed as x0 + dx * i.
+   */
+  template <class Ty>
+  static void _fillUniform(QVector<QPointF> &points, qreal x0, qreal dx,
+                           const SampleRef<Ty> &y) {
+    points.resize(y.rows());
+    _fillUniform<Ty>(points.data(), x0, dx, y);
+  }
+
+  template <class Ty>
+  static void _fillUniform(QPointF *points, qreal x0, qreal dx,
+                           const SampleRef<Ty> &y) {
+    const int n = y.rows();
+    qreal *dst = reinterpret_cast<qreal *>(points);
+    const Ty *ys = y.data();
+    for (int i = 0; i < n; i++) {
+      dst[2 * i] = x0 + dx * i;
+      dst[2 * i + 1] = ys[i];
+    }
+  }
+
+  /* _uniformBounds(): bounds of n values of x sampled at a fixed step, in
+   * O(1).
+   */
+  static void _uniformBounds(qreal x0, qreal dx, qint64 n, qreal &xMin,
+                             qreal &xMax) {
+    if (n <= 0) {
+      xMin = std::numeric_limits<qreal>::infinity();
+      xMax = -xMin;
+      return;
+    }
+
+    const qreal x1 = x0 + dx * (n - 1);
+    xMin = std::min(x0, x1);
+    xMax = std::max(x0, x1);
+  }
+
+  /* _evalPoints(): evaluates the coefficients of the x and y expressions
+   * straight into a buffer of QPointF, finding their bounds in the same pass.
+   * NaNs are skipped by the bounds, like in _minMax().
+   */
+  template <class Dx, class Dy>
+  static void _evalPoints(QVector<QPointF> &points,
+                          const Eigen::ArrayBase<Dx> &x,
+                          const Eigen::ArrayBase<Dy> &y, qreal &xMin,
+                          qreal &xMax, qreal &yMin, qreal &yMax) {
+    // coeff() computes each coefficient of an expression on demand
+    const Dx &ex = x.derived();
+    const Dy &ey = y.derived();
+
+    const int n = x.rows();
+    points.resize(n);
+    qreal *dst = reinterpret_cast<qreal *>(points.data());
+
+    const qreal inf = std::numeric_limits<qreal>::infinity();
+    xMin = yMin = inf;
+    xMax = yMax = -inf;
+    for (int i = 0; i < n; i++) {
+      const qreal vx = ex.coeff(i), vy = ey.coeff(i);
+      dst[2 * i] = vx;
+      dst[2 * i + 1] = vy;
+      xMin = vx < xMin ? vx : xMin;
+      xMax = vx > xMax ? vx : xMax;
+      yMin = vy < yMin ? vy : yMin;
+      yMax = vy > yMax ? vy : yMax;
+    }
+  }
+
+  /* _beginOffscreen(): builds the chart and lays it out for a device of
+   * width x height pixels at dpi, outside of any window. A width or height of
+   * 0 is replaced by the size used by show(). Must be paired with
+   * _endOffscreen().
+   */
+  bool _beginOffscreen(int &width, int &height, int dpi, QSizeF &oldSize) {
+    if (dpi <= 0) {
+      qCritical() << "render()!!! dpi must be > 0 but it is " << dpi;
+      return false;
+    }
+
+    if (!_buildChart())
+      return false;
+
+    const qreal scale = qreal(dpi) / DEFAULT_DPI;
+    if (width <= 0)
+      width = qRound(_width * scale);
+    if (height <= 0)
+      height = qRound(_height * scale);
+
+    // a chart that was never shown lives in a scene of its own
+    if (!_chart->scene()) {
+      if (!_scene)
+        _scene = new QGraphicsScene();
+      _scene->addItem(_chart);
+    }
+
+    // OpenGL series are painted by the view, not by the scene
+    _setUseOpenGL(false);
+
+    // lay the chart out at its logical size, the painter scales it by dpi
+    oldSize = _chart->size();
+    _chart->resize(width / scale, height / scale);
+    _chart->layout()->activate();
+    return true;
+  }
+
+  /* _paintOffscreen(): paints the chart laid out by _beginOffscreen(). */
+  void _paintOffscreen(QPainter *painter, int width, int height) {
+    _chart->scene()->render(painter, QRectF(0, 0, width, height),
+                            QRectF(_chart->pos(), _chart->size()),
+                            Qt::IgnoreAspectRatio);
+  }
+
+  /* _endOffscreen(): gives the chart back to its window, if there's one. */
+  void _endOffscreen(const QSizeF &oldSize) {
+    if (_chartView) {
+      _chart->resize(oldSize);
+      _setUseOpenGL(_useOpenGL);
+    }
+  }
+
+  /* _saveVector(): writes the chart as a SVG or PDF document.
+   * Qt Charts paints each line series as a single path, so the document
+   * holds one compact path per series. Before painting, the points of every
+   * series are merged down to about one per device pixel, which keeps the
+   * document small no matter how many points were plotted. The simplified
+   * points go to copies of the series, painted in their place: the series
+   * themselves, which may be on screen, are only hidden meanwhile.
+   */
+  void _saveVector(const QString &filename, const QString &format, int width,
+                   int height, int dpi) {
+    QSizeF oldSize;
+    if (!_beginOffscreen(width, height, dpi, oldSize))
+      return;
+
+    const qreal scale = qreal(dpi) / DEFAULT_DPI;
+    const QRectF plotArea = _chart->plotArea();
+    const QRectF area(plotArea.topLeft() * scale, plotArea.size() * scale);
+
+    QVector<QPointF> simplified;
+    std::vector<std::unique_ptr<QtCharts::QXYSeries>> copies;
+    for (SeriesData &data : _seriesVec) {
+      if (data.isDensity) // already painted as an image
+        continue;
+
+      // chart values -> device pixels, from the layout of the chart
+      QtCharts::QXYSeries *series = data.series.get();
+      const QPointF o = _chart->mapToPosition(QPointF(0, 0), series);
+      const QPointF ex = _chart->mapToPosition(QPointF(1, 0), series) - o;
+      const QPointF ey = _chart->mapToPosition(QPointF(0, 1), series) - o;
+      const QTransform toDevice =
+          QTransform(ex.x(), ex.y(), ey.x(), ey.y(), o.x(), o.y()) *
+          QTransform::fromScale(scale, scale);
+
+      _simplifyPoints(data.points, simplified, toDevice, area, data.isScatter);
+      copies.emplace_back(_copySeries(*series, data.isScatter));
+      QtCharts::QXYSeries *copy = copies.back().get();
+      copy->replace(simplified);
+      _chart->addSeries(copy);
+      for (QtCharts::QAbstractAxis *axis : series->attachedAxes())
+        copy->attachAxis(axis);
+      // the legend hides the marker of a hidden series: it keeps showing the
+      // one of the series, in its place, rather than the one of the copy
+      series->setVisible(false);
+      for (QtCharts::QLegendMarker *marker : _chart->legend()->markers(copy))
+        marker->setVisible(false);
+      for (QtCharts::QLegendMarker *marker : _chart->legend()->markers(series))
+        marker->setVisible(true);
+#if (DEBUG > 1) && (DEBUG < 3)
+      qDebug() << "_saveVector():" << data.name << "simplified"
+               << data.points.size() << "points to" << simplified.size();
+#endif
+    }
+
+    bool ok = false;
+    QPainter painter;
+    if (format == "pdf") {
+      QPdfWriter pdf(filename);
+      pdf.setResolution(dpi);
+      pdf.setPageSize(QPageSize(QSizeF(width * 25.4 / dpi, height * 25.4 / dpi),
+                                QPageSize::Millimeter));
+      pdf.setPageMargins(QMarginsF(0, 0, 0, 0));
+      pdf.setTitle(_title);
+      if (painter.begin(&pdf)) {
+        _paintOffscreen(&painter, width, height);
+        ok = painter.end();
+      }
+    } else {
+#ifndef NO_SVG
+      QSvgGenerator svg;
+      svg.setFileName(filename);
+      svg.setSize(QSize(width, height));
+      svg.setViewBox(QRect(0, 0, width, height));
+      svg.setResolution(dpi);
+      svg.setTitle(_title);
+      if (painter.begin(&svg)) {
+        _paintOffscreen(&painter, width, height);
+        ok = painter.end();
+      }
+#else
+      qCritical() << "savefig()!!! SVG support was disabled by NO_SVG.";
 #endif
+    }
+
+    if (!ok)
+      qCritical() << "savefig()!!! failed to write" << filename;
+
+    // the copies leave the chart before they are deleted
+    for (const std::unique_ptr<QtCharts::QXYSeries> &copy : copies)
+      _chart->removeSeries(copy.get());
+    for (SeriesData &data : _seriesVec)
+      if (!data.isDensity)
+        data.series->setVisible(true);
+
+    _endOffscreen(oldSize);
+  }
+
+  /* _copySeries(): a new series, with no points, that looks like series.
+   */
+  static QtCharts::QXYSeries *_copySeries(const QtCharts::QXYSeries &series,
+                                          bool isScatter) {
+    QtCharts::QXYSeries *copy;
+    if (isScatter) {
+      const QtCharts::QScatterSeries &scatter =
+          static_cast<const QtCharts::QScatterSeries &>(series);
+      QtCharts::QScatterSeries *s = new QtCharts::QScatterSeries();
+      s->setMarkerSize(scatter.markerSize());
+      s->setMarkerShape(scatter.markerShape());
+      copy = s;
+    } else {
+      copy = new QtCharts::QLineSeries();
+      copy->setPointsVisible(series.pointsVisible());
+    }
+
+    copy->setName(series.name());
+    copy->setPen(series.pen());
+    copy->setBrush(series.brush());
+    return copy;
+  }
+
+  /* _simplifyPoints(): merges the points of a series that fall on the same
+   * device pixel. toDevice maps chart values to device pixels.
+   * Lines keep the first, last, min and max points of every pixel column,
+   * like _decimateM4(), and then drop the points landing on the same pixel
+   * as the point before them. Scatter plots keep a single marker per pixel
+   * of the plot area, any other would be painted right over it.
+   */
+  static void _simplifyPoints(const QVector<QPointF> &in, QVector<QPointF> &out,
+                              const QTransform &toDevice, const QRectF &area,
+                              bool isScatter) {
+    const int n = in.size();
+    out.clear();
+
+    if (isScatter) {
+      const int w = qCeil(area.width()) + 1;
+      const int h = qCeil(area.height()) + 1;
+      std::vector<bool> taken(size_t(w) * h, false);
+      for (int i = 0; i < n; i++) {
+        const QPointF d = toDevice.map(in[i]) - area.topLeft();
+        if (!(d.x() >= 0 && d.y() >= 0 && d.x() < w && d.y() < h))
+          continue; // outside the plot area (or NaN)
+
+        const size_t key = size_t(d.y()) * w + size_t(d.x());
+        if (!taken[key]) {
+          taken[key] = true;
+          out.push_back(in[i]);
+        }
+      }
+      return;
+    }
+
+    bool hasPrev = false;
+    qreal prevX = 0, prevY = 0;
+    int i = 0;
+    while (i < n) {
+      const QPointF first = toDevice.map(in[i]);
+      const qreal col = std::floor(first.x());
+      int iMin = i, iMax = i, last = i;
+      qreal yMin = first.y(), yMax = first.y();
+
+      int j = i + 1;
+      for (; j < n; j++) {
+        const QPointF d = toDevice.map(in[j]);
+        if (std::floor(d.x()) != col)
+          break;
+        if (d.y() < yMin)
+          yMin = d.y(), iMin = j;
+        if (d.y() > yMax)
+          yMax = d.y(), iMax = j;
+        last = j;
+      }
+
+      int idx[4] = {i, iMin, iMax, last};
+      std::sort(idx, idx + 4);
+      for (int k = 0; k < 4; k++) {
+        if (k && idx[k] == idx[k - 1])
+          continue;
+
+        const QPointF d = toDevice.map(in[idx[k]]);
+        const qreal px = std::floor(d.x()), py = std::floor(d.y());
+        if (!hasPrev || px != prevX || py != prevY)
+          out.push_back(in[idx[k]]);
+        hasPrev = true;
+        prevX = px;
+        prevY = py;
+      }
+
+      i = j;
+    }
+  }
+
+  /* _setUseOpenGL(): switches OpenGL acceleration of every series. It only
+   * works inside a QChartView, so it's turned off to render offscreen.
+   */
+  void _setUseOpenGL(bool enable) {
+    for (SeriesData &data : _seriesVec)
+      if (data.series && data.series->useOpenGL() != enable)
+        data.series->setUseOpenGL(enable);
+  }
+
+  /* _pushSamples(): stores new samples at the end of the series' buffer.
+   * Bounded series use it as a ring buffer: once it's full, head moves
+   * forward and the oldest samples get overwritten. Unbounded series grow
+   * geometrically so that appending stays amortized O(1) per sample.
+   */
+  template <class Tx, class Ty>
+  static void _pushSamples(SeriesData &data, const SampleRef<Tx> &x,
+                           const SampleRef<Ty> &y) {
+    const int tail = _ringTail(data);
+    _pushColumn(data, data.x, x);
+    _pushColumn(data, data.y, y);
+    _advance(data, y.rows());
+    _boundBlocks(data, tail, y.rows());
+  }
+
+  /* _pushSamples(): same as above, for series whose x is sampled at a fixed
+   * step. Only y is stored.
+   */
+  template <class Ty>
+  static void _pushSamples(SeriesData &data, const SampleRef<Ty> &y) {
+    const int tail = _ringTail(data);
+    _pushColumn(data, data.y, y);
+    _advance(data, y.rows());
+    _boundBlocks(data, tail, y.rows());
+  }
+
+  /* _ringTail(): index of the ring buffer of data the next sample goes to.
+   */
+  static int _ringTail(const SeriesData &data) {
+    return data.capacity ? (data.head + data.count) % data.capacity : 0;
+  }
+
+  /* _boundBlocks(): measures again the blocks of the ring buffer of data
+   * that the last k samples, written from index tail on, went to. Once the
+   * buffer drops samples, _autoscale() joins the bounds of its blocks
+   * instead of reading the samples themselves.
+   */
+  static void _boundBlocks(SeriesData &data, int tail, qint64 k) {
+    const int cap = data.capacity;
+    if (cap == 0)
+      return;
+
+    // the samples were written in up to two segments; until the buffer is
+    // full head is 0, so the valid samples are the first count
+    const int m = static_cast<int>(std::min<qint64>(k, cap));
+    const int segments[2][2] = {{tail, std::min(tail + m, cap)},
+                                {0, std::max(0, tail + m - cap)}};
+    for (const auto &segment : segments) {
+      for (int b = segment[0] / RING_BLOCK; b * RING_BLOCK < segment[1];
+           b++) {
+        const int i = b * RING_BLOCK;
+        const int n = std::min(RING_BLOCK, data.count - i);
+        qreal xMin = 0, xMax = 0, yMin, yMax;
+        if (data.uniform)
+          _minMax<float>(data.y.segment(i, n), yMin, yMax);
+        else
+          _minMax<float, float>(data.x.segment(i, n), data.y.segment(i, n),
+                                xMin, xMax, yMin, yMax);
+        data.blocks.col(b) << xMin, xMax, yMin, yMax;
+      }
+    }
+  }
+
+  /* _pushColumn(): writes new samples after the last one stored in column,
+   * which is either data.x or data.y. The counters are left to _advance().
+   */
+  template <class T>
+  static void _pushColumn(const SeriesData &data, Eigen::ArrayXf &column,
+                          const SampleRef<T> &v) {
+    const int k = v.rows();
+
+    if (data.capacity == 0) {
+      if (data.count + k > column.rows()) {
+        const int size = std::max<int>(2 * column.rows(), data.count + k);
+        column.conservativeResize(size);
+      }
+      column.segment(data.count, k) = v.template cast<float>();
+      return;
+    }
+
+    // samples that would be overwritten by the same call are skipped
+    const int cap = data.capacity;
+    const int skip = std::max(0, k - cap);
+    const int m = k - skip;
+
+    const int tail = (data.head + data.count) % cap;
+    const int first = std::min(m, cap - tail); // until the end of the buffer
+    column.segment(tail, first) = v.segment(skip, first).template cast<float>();
+    column.head(m - first) =
+        v.segment(skip + first, m - first).template cast<float>();
+  }
 
-    if (marker != "-" && marker != "--" && marker != "." && marker != "o" &&
-        marker != "s") {
-      qCritical() << "plot(x,y): unknown marker '" << marker << "'.";
+  /* _advance(): accounts for k samples written by _pushColumn(), dropping the
+   * oldest ones when the capacity is exceeded.
+   */
+  static void _advance(SeriesData &data, int k) {
+    const qint64 total = qint64(data.count) + k;
+
+    if (data.capacity == 0) {
+      data.count = total;
       return;
     }
 
-    if (x.rows() != y.rows()) {
-      qCritical() << "plot(x,y): x.sz=" << x.cols() << " != y.sz=" << y.rows();
-      exit(-1);
+    const int cap = data.capacity;
+    data.count += std::min(k, cap);
+    if (data.count > cap) {
+      data.head = (data.head + data.count - cap) % cap;
+      data.count = cap;
     }
+    data.start += total - data.count;
+  }
 
-    if (x.rows() == 0 || y.rows() == 0) {
-      qCritical() << "plot(x,y): axis size must be > 0 but it is x.sz="
-                  << x.rows() << " y.sz=" << y.rows();
-      exit(-1);
+  /* _appendSamples(): pushes x and y at the end of data and grows its
+   * bounds. The Qt series is left to the caller.
+   */
+  template <class Tx, class Ty>
+  void _appendSamples(SeriesData &data, const SampleRef<Tx> &x,
+                      const SampleRef<Ty> &y) {
+    // samples going back in x can't be indexed, the series keeps them as is
+    if (data.lod && !_appendLod(*data.lod, x, y))
+      _releaseLod(data);
+
+    if (data.lod) {
+      data.uniform = false;
+    } else {
+      // x given to a series sampled at a fixed step: from now on it is stored
+      if (data.uniform)
+        _storeX(data);
+
+      // the bounds of the series grow with the new samples only, but once
+      // the ring buffer drops samples they have to be measured again
+      const int before = data.count;
+      _pushSamples(data, x, y);
+      if (data.count < before + x.rows())
+        data.boundsStale = true;
     }
 
-    // Make a copy because it's show() who setup these things
-    _legend = label;
+    qreal xMin, xMax, yMin, yMax;
+    _minMax(x, y, xMin, xMax, yMin, yMax);
+    _growLimits(xMin, xMax, yMin, yMax);
+    data.xMin = std::min<qreal>(data.xMin, xMin);
+    data.xMax = std::max<qreal>(data.xMax, xMax);
+    data.yMin = std::min<qreal>(data.yMin, yMin);
+    data.yMax = std::max<qreal>(data.yMax, yMax);
+
+    if (data.lod)
+      _queryLod(data, data.decimated[0], data.decimated[1]);
+    else if (_keepsSamples(data))
+      _decimateSamples(data, data.decimated[0], data.decimated[1]);
+    else if (data.capacity == 0)
+      _fillPoints<Tx, Ty>(_appendPoints(data, x.rows()), x, y);
+    data.dirty = true;
+  }
 
-    // find min and max values to define the range of the X axis
-    qreal xMin = x.minCoeff();
-    qreal xMax = x.maxCoeff();
-    if (xMin < _xMin)
-      _xMin = xMin;
-    if (xMax > _xMax)
-      _xMax = xMax;
+  /* _appendSamples(): same as above, for a series sampled at a fixed step.
+   */
+  template <class Ty>
+  void _appendSamples(SeriesData &data, const SampleRef<Ty> &y) {
+    qint64 count;
+    if (data.lod) {
+      _appendLod(*data.lod, y);
+      count = data.lod->size();
+    } else {
+      const int before = data.count;
+      _pushSamples(data, y);
+      if (data.count < before + y.rows())
+        data.boundsStale = true;
+      count = data.count;
+    }
 
-    // find min and max values to stablish the range of the Y axis
-    // however, if a new series brings more xtreme values, we need to respect
-    // that!
-    qreal yMin = y.minCoeff();
-    qreal yMax = y.maxCoeff();
-    if (yMin < _yMin)
-      _yMin = yMin;
-    if (yMax > _yMax)
-      _yMax = yMax;
+    // the bounds of x are known in O(1)
+    qreal xMin, xMax, yMin, yMax;
+    _uniformBounds(data.x0 + data.dx * data.start, data.dx, count, xMin,
+                   xMax);
+    _minMax(y, yMin, yMax);
+    _growLimits(xMin, xMax, yMin, yMax);
+    data.xMin = xMin;
+    data.xMax = xMax;
+    data.yMin = std::min<qreal>(data.yMin, yMin);
+    data.yMax = std::max<qreal>(data.yMax, yMax);
+
+    if (data.lod)
+      _queryLod(data, data.decimated[0], data.decimated[1]);
+    else if (_keepsSamples(data))
+      _decimateSamples(data, data.decimated[0], data.decimated[1]);
+    else if (data.capacity == 0)
+      _fillUniform<Ty>(_appendPoints(data, y.rows()),
+                       data.x0 + data.dx * (data.start + count - y.rows()),
+                       data.dx, y);
+    data.dirty = true;
+  }
 
-#if (DEBUG > 1) && (DEBUG < 3)
-    qDebug() << "plot(x,y): xrange [" << _xMin << "," << _xMax << "]  yrange ["
-             << _yMin << "," << _yMax << "]";
-#endif
+  /* _appendPoints(): makes room for n points at the end of the points of an
+   * unbounded series, which grow geometrically like its samples. Returns the
+   * first of them.
+   */
+  static QPointF *_appendPoints(SeriesData &data, int n) {
+    QVector<QPointF> &points = data.points;
+    const int size = points.size();
+    if (size + n > points.capacity())
+      points.reserve(std::max(2 * size, size + n));
+    points.resize(size + n);
+    return points.data() + size;
+  }
 
-    std::shared_ptr<QtCharts::QXYSeries> series;
-    auto itr = _seriesVec.find(_legend);
-    if (itr != _seriesVec.end()) {
-      series = *itr;
-    } else {
-      if (marker == "o" || marker == "s") // it's a scatter plot!
-      {
-#if (DEBUG > 1) && (DEBUG < 3)
-        qDebug() << "plot(x,y): scatter plot";
-#endif
-        QtCharts::QScatterSeries *s = new QtCharts::QScatterSeries();
-        s->setMarkerSize(markersize); // symbol size
+  /* _drainInboxes(): appends the samples waiting in the queues of ingest(),
+   * in a single bulk update per series. Returns true if there were any.
+   */
+  bool _drainInboxes() {
+    bool drained = false;
+    for (SeriesData &data : _seriesVec) {
+      if (!data.inbox)
+        continue;
+
+      const int n = data.inbox->pop(_drainX, _drainY);
+      if (n == 0 || !_appendTarget(&data, n))
+        continue;
+
+      if (data.uniform)
+        _appendSamples<float>(data, _drainY.head(n));
+      else
+        _appendSamples<float, float>(data, _drainX.head(n), _drainY.head(n));
+      drained = true;
+    }
+    return drained;
+  }
+
+  /* _startDrainTimer(): has the GUI thread drain the queues of ingest() once
+   * per frame while the chart is on screen. Charts that were never given a
+   * queue don't get a timer.
+   */
+  void _startDrainTimer() {
+    if (_drainTimer || !_chartView)
+      return;
 
-        if (marker == "o")
-          s->setMarkerShape(QtCharts::QScatterSeries::MarkerShapeCircle);
+    bool queued = false;
+    for (const SeriesData &data : _seriesVec)
+      queued = queued || data.inbox;
+    if (!queued)
+      return;
 
-        if (marker == "s")
-          s->setMarkerShape(QtCharts::QScatterSeries::MarkerShapeRectangle);
+    _drainTimer = new QTimer(_chartView); // deleted by _destroyChart()
+    QObject::connect(_drainTimer, &QTimer::timeout, _drainTimer, [this]() {
+      std::lock_guard<std::recursive_mutex> lock(_mutex);
+      if (_drainInboxes())
+        _buildChart();
+    });
+    _drainTimer->start(DEFAULT_DRAIN_MS);
+  }
 
-        series.reset((QtCharts::QXYSeries *)s);
-        series->setUseOpenGL(true);
-      } else // draw line
-      {
-#if (DEBUG > 1) && (DEBUG < 3)
-        qDebug() << "plot(x,y): line plot";
-#endif
-        series.reset(new QtCharts::QLineSeries());
-        series->setUseOpenGL(true);
+  /* _appendTarget(): prepares the series append() writes n samples to. On
+   * the first append() to an unbounded series, it takes over the points that
+   * were given to plot(), unless its samples are already kept, by a LOD index
+   * or for decimation. Returns NULL when there's nothing to append to.
+   */
+  SeriesData *_appendTarget(SeriesData *target, int n) {
+    if (!target || n == 0)
+      return NULL;
+
+    SeriesData &data = *target;
+    if (data.capacity == 0 && data.y.rows() == 0 && data.points.size() &&
+        !data.lod) {
+      const QVector<QPointF> &points = data.points;
+      if (!data.uniform)
+        data.x.resize(points.size());
+      data.y.resize(points.size());
+      for (int i = 0; i < points.size(); i++) {
+        if (!data.uniform)
+          data.x[i] = points[i].x();
+        data.y[i] = points[i].y();
       }
+      data.head = 0;
+      data.count = points.size();
+      data.start = 0;
     }
-    // Call a string parser! Ex: "label=Trump Tweets" becomes "Trump Tweets"
-    _parseLegend();
-    if (_legend.size()) {
-#if (DEBUG > 1) && (DEBUG < 3)
-      qDebug() << "plot(x,y): label=" << _legend;
-#endif
-      series->setName(_legend);
-    }
 
-    if (series->count() == x.rows()) {
-      for (int i = 0; i < x.rows(); i++)
-        series->replace(i, x[i], y[i]);
+    return &data;
+  }
+
+  /* _storeX(): computes and stores x of a series sampled at a fixed step, so
+   * it can be given explicit x values.
+   */
+  static void _storeX(SeriesData &data) {
+    const int size = data.y.rows();
+    data.x.resize(size);
+    for (int j = 0; j < data.count; j++)
+      data.x[(data.head + j) % size] = data.x0 + data.dx * (data.start + j);
+    data.uniform = false;
+    _boundBlocks(data, data.head, data.count);
+  }
+
+  /* _layoutRing(): makes the points of a bounded series from its ring
+   * buffer, oldest first. A decimated line series is decimated with "m4"
+   * for the range of the x axis, or of its data before the chart is built.
+   */
+  void _layoutRing(SeriesData &data) {
+    QVector<QPointF> &points = data.points;
+    points.resize(data.count);
+    const int first = std::min<int>(data.count, data.y.rows() - data.head);
+    if (data.uniform) {
+      const qreal x0 = data.x0 + data.dx * data.start;
+      _fillUniform<float>(points.data(), x0, data.dx,
+                          data.y.segment(data.head, first));
+      _fillUniform<float>(points.data() + first, x0 + data.dx * first,
+                          data.dx, data.y.head(data.count - first));
     } else {
-      series->clear();
-      for (int i = 0; i < x.rows(); i++) {
-#if (DEBUG > 1) && (DEBUG < 3)
-        qDebug() << "plot(x,y): x[" << i << "]=" << x[i] << " y[" << i
-                 << "]=" << y[i];
-#endif
-        series->append(x[i], y[i]);
-      }
+      _fillPoints<float, float>(points.data(),
+                                data.x.segment(data.head, first),
+                                data.y.segment(data.head, first));
+      _fillPoints<float, float>(points.data() + first,
+                                data.x.head(data.count - first),
+                                data.y.head(data.count - first));
     }
 
-    // Customize series color and transparency
-    QColor fillColor = color;
-    if (fillColor == DEFAULT_COLOR)
-      fillColor = _colors[_colorIdx++];
-    fillColor.setAlphaF(alpha);
+    if (data.decimate == PlotOptions::DecimateNone || data.isScatter ||
+        data.count <= 4 * _width)
+      return;
 
-    QPen pen = series->pen();
-    pen.setWidth(linewidth);
+    // x and y of the points, read in place
+    typedef Eigen::Map<const Eigen::Array<qreal, Eigen::Dynamic, 1>, 0,
+                       Eigen::InnerStride<2>>
+        Column;
+    const QVector<QPointF> samples = points;
+    const qreal *values = reinterpret_cast<const qreal *>(samples.data());
+    const bool shown = _xRange[1] > _xRange[0];
+    _decimateM4(points, Column(values, data.count),
+                Column(values + 1, data.count),
+                shown ? _xRange[0] : data.xMin, shown ? _xRange[1] : data.xMax,
+                _width);
+  }
 
-    if (marker == "o" || marker == "s") {
-      if (edgecolor == DEFAULT_EDGECOLOR) {
-        pen.setColor(fillColor); // outline should be invisible
-#if (DEBUG > 1) && (DEBUG < 3)
-        qDebug() << "plot(x,y): fillColor=" << fillColor;
-#endif
-      } else {
-#if (DEBUG > 1) && (DEBUG < 3)
-        qDebug() << "plot(x,y): edgecolor=" << edgecolor;
-#endif
-        QColor edgeColor = edgecolor;
-        edgeColor.setAlphaF(alpha);
-        pen.setColor(edgeColor); // create circle outline
-      }
-    } else if (marker == "--") {
-      pen.setStyle(Qt::DashLine);
-      pen.setColor(fillColor);
-    } else if (marker == ".") {
-      pen.setStyle(Qt::DotLine);
-      pen.setColor(fillColor);
-    } else // marker == "-"
-    {
-      pen.setColor(fillColor);
+  /* _syncSeries(): creates the Qt series if needed and hands it the style
+   * and points of data, through a single replace(). Must run on the GUI
+   * thread.
+   */
+  static void _syncSeries(SeriesData &data) {
+    if (!data.series) {
+      if (data.isScatter)
+        data.series.reset(new QtCharts::QScatterSeries());
+      else
+        data.series.reset(new QtCharts::QLineSeries());
     }
 
-    series->setPen(pen);
-    series->setBrush(QBrush(fillColor));
+    if (data.isScatter) {
+      QtCharts::QScatterSeries *s =
+          static_cast<QtCharts::QScatterSeries *>(data.series.get());
+      s->setMarkerSize(data.markersize); // symbol size
 
-    if (_colorIdx >= _colors.size())
-      _colorIdx = 0;
+      if (data.style.marker == PlotStyle::MarkerCircle)
+        s->setMarkerShape(QtCharts::QScatterSeries::MarkerShapeCircle);
 
-    //_seriesVec.push_back(series);
-    _seriesVec[_legend] = series;
+      if (data.style.marker == PlotStyle::MarkerSquare)
+        s->setMarkerShape(QtCharts::QScatterSeries::MarkerShapeRectangle);
+    } else {
+      // lines with a marker, like "r--o", show their points
+      data.series->setPointsVisible(data.style.marker !=
+                                    PlotStyle::MarkerNone);
+    }
 
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "plot(x,y): -----";
-#endif
+    data.series->setName(data.name);
+    data.series->setPen(data.pen);
+    data.series->setBrush(data.brush);
+    // density series stay on the chart for the legend, with no points
+    data.series->replace(data.isDensity ? QVector<QPointF>() : data.points);
+    data.dirty = false;
   }
 
-  /* show(): displays all the data added through plot() calls.
+  /* _refresh(): updates a series right away if the chart is on screen.
+   * Otherwise it's up to the next show() or render(). The series of a chart
+   * shown by show_async() are updated by the redraw of the GUI thread.
    */
-  void show() {
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "show(): " << _title;
-#endif
-    if (!_seriesVec.size()) {
-      qCritical() << "show()!!! Must set the data with plot() before show().";
+  void _refresh(SeriesData &data) {
+    if (_window)
       return;
+
+    if (_isWidget && _chartView && _chartView->isVisible() &&
+        data.series && data.series->chart()) {
+      if (data.capacity > 0)
+        _layoutRing(data);
+      _syncSeries(data);
+      if (data.isDensity)
+        _rasterPlotArea();
     }
+  }
 
-    /* Customize chart title */
+  /* _releaseSeries(): gives up the Qt series of data. Qt aborts if a series
+   * is deleted while it's still on a chart. When the chart was shown by
+   * show_async(), it's the GUI thread that takes it off the chart, during
+   * the next redraw.
+   */
+  void _releaseSeries(SeriesData &data) {
+    if (data.series && _window) {
+      _retiredSeries.push_back(std::move(data.series));
+      return;
+    }
 
-    QFont font;
-    font.setPixelSize(12);
-    font.setWeight(QFont::Bold);
-    _chart->setTitleFont(font);
-    _chart->setTitle(_title);
+    if (data.series && _chart && data.series->chart() == _chart)
+      _chart->removeSeries(data.series.get());
+    data.series.reset();
+  }
 
-    // TODO: investigate detaching the legend for custom positioning
-    // https://doc.qt.io/qt-5/qtcharts-legend-example.html
+  /* _destroyChart(): deletes the Qt objects of the chart.
+   */
+  void _destroyChart() {
+    if (!_chart)
+      return;
 
-    if (_legendPos.size()) {
-      if (_legendPos == "lower center") // 9
-        _chart->legend()->setAlignment(Qt::AlignBottom);
-      else if (_legendPos == "upper center") // 8
-        _chart->legend()->setAlignment(Qt::AlignTop);
-      else if (_legendPos == "center right") // 7
-        _chart->legend()->setAlignment(Qt::AlignRight);
-      else if (_legendPos == "center left") // 6
-        _chart->legend()->setAlignment(Qt::AlignLeft);
-      else {
-        qCritical() << "show()!!!" << _legendPos
-                    << " is not a valid legend position.";
-        _chart->legend()->setAlignment(Qt::AlignBottom);
-      }
+    // series are owned by _seriesVec, make sure Qt doesn't delete them too
+    for (QtCharts::QAbstractSeries *series : _chart->series())
+      _chart->removeSeries(series);
+
+    // the chart of a widget outlives this object, its signals can't reach it
+    QObject::disconnect(_rangeConnection);
+    QObject::disconnect(_plotAreaConnection);
+    delete _drainTimer;
+    _drainTimer = NULL;
+
+    // a widget belongs to the Qt GUI it was shown on, so it's not deleted
+    if (_chartView) {
+      if (!_isWidget)
+        delete _chartView; // also deletes _chart
+    } else if (_chart->scene() != _scene) {
+      delete _chart;
     }
+    delete _scene; // deletes _chart if it was only rendered offscreen
+  }
 
-    if (_legend.size())
-      _chart->legend()->setVisible(true);
-    else
-      _chart->legend()->setVisible(false);
+  /* AsyncWindow: the window of show_async(), as seen by the caller.
+   */
+  struct AsyncWindow {
+    std::promise<void> promise;
+    std::shared_future<void> closed; // ready once the window is closed
+    std::atomic<bool> done;
 
-      /* Customize X, Y axis and categories */
+    AsyncWindow() : closed(promise.get_future().share()), done(false) {}
 
-#if (DEBUG > 1) && (DEBUG < 3)
-    qDebug() << "show(): xrange [" << _xMin << "," << _xMax << "] "
-             << " yrange [" << _yMin << "," << _yMax << "]";
-#endif
+    void close() {
+      if (!done.exchange(true))
+        promise.set_value();
+    }
+    bool isClosed() const { return done; }
+  };
 
-    QPen axisPen(Qt::black); // default axis line color and width
-    axisPen.setWidth(1);
+  /* FigureEdit: held by every call that changes the figure. It keeps the
+   * GUI thread of show_async() from drawing the figure while it changes, and
+   * then asks it for a redraw. Edits may nest.
+   */
+  class FigureEdit {
+  public:
+    explicit FigureEdit(Madplotlib *plt) : _plt(plt) { _plt->_mutex.lock(); }
+    ~FigureEdit() {
+      _plt->_requestRedraw();
+      _plt->_mutex.unlock();
+    }
 
-    QtCharts::QValueAxis *axisX = NULL;
-    QtCharts::QCategoryAxis *categoryX = NULL;
-    if (_showXticks == SHOW_TICK || _showXticks == HIDE_TICK) {
-      bool add = true;
-      if (_xAxisBottom) {
-        axisX = dynamic_cast<QtCharts::QValueAxis *>(_xAxisBottom);
-        add = false;
-      } else {
-        axisX = new QtCharts::QValueAxis;
-      }
-      axisX->setGridLineVisible(_enableGrid);
-      axisX->setTitleText(_xLabel);
-      axisX->setLinePen(axisPen);
-      axisX->setRange(_xMin, _xMax);
-      axisX->setTickCount(_xTickCount);
-      if (!_customLimits)
-        axisX->applyNiceNumbers();
-      if (add)
-        _chart->addAxis(axisX, Qt::AlignBottom);
-      _xAxisBottom = axisX;
-      if (_showXticks == HIDE_TICK)
-        axisX->setLabelsVisible(false);
-    } else if (_showXticks == SHOW_CUSTOM_TICK) {
-      categoryX = new QtCharts::QCategoryAxis();
-      categoryX->setGridLineVisible(_enableGrid);
-      categoryX->setLinePen(axisPen);
-
-      if (_showXticks && _xTicks.size())
-        for (int i = 0; i < _xTicks.size(); i++) {
-#if (DEBUG > 1) && (DEBUG < 3)
-          qDebug() << "show(): xtick[" << i << "]=(" << _xTicks[i].second
-                   << " , " << _xTicks[i].first << ")";
-#endif
-          categoryX->append(_xTicks[i].first, _xTicks[i].second);
-        }
+  private:
+    Madplotlib *_plt;
+  };
 
-      categoryX->setRange(_xMin, _xMax);
-      categoryX->setTickCount(_xTicks.size());
-      if (_xAxisBottom)
-        _chart->removeAxis(_xAxisBottom);
-      _chart->addAxis(categoryX, Qt::AlignBottom);
-      _xAxisBottom = categoryX;
+  /* FrameExporter: writes the frames of animate() to image files, on
+   * background threads. The frames waiting to be written are bounded: when
+   * the disk falls behind, new frames are dropped and counted, so neither
+   * the memory nor the GUI thread pay for it.
+   */
+  class FrameExporter {
+  public:
+    explicit FrameExporter(const QString &pattern)
+        : _pattern(pattern), _done(false), _saved(0), _failed(0),
+          _dropped(0) {
+      const int threads = std::max(1, QThread::idealThreadCount() / 2);
+      _maxQueued = 2 * threads;
+      for (int i = 0; i < threads; i++)
+        _pool.emplace_back([this]() { _work(); });
     }
 
-    QtCharts::QValueAxis *axisY = NULL;
-    QtCharts::QCategoryAxis *categoryY = NULL;
-    if (_showYticks == SHOW_TICK ||
-        _showYticks == HIDE_TICK) // this is the default ticks setup
-    {
-      bool add = true;
-      if (_yAxisLeft) {
-        axisY = dynamic_cast<QtCharts::QValueAxis *>(_yAxisLeft);
-        add = false;
-      } else {
-        axisY = new QtCharts::QValueAxis;
+    ~FrameExporter() { finish(); }
+
+    /* push(): queues the image of a frame to be written, or drops it if
+     * the queue is full.
+     */
+    void push(int frame, const QImage &image) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (_queue.size() >= _maxQueued) {
+        _dropped++;
+        return;
       }
+      _queue.push_back(std::make_pair(frame, image));
+      _ready.notify_one();
+    }
 
-      axisY->setGridLineVisible(_enableGrid);
-      axisY->setTitleText(_yLabel);
-      axisY->setLinePen(axisPen);
-      axisY->setRange(_yMin, _yMax);
-      axisY->setTickCount(_yTickCount);
-      if (!_customLimits)
-        axisY->applyNiceNumbers();
-      if (add)
-        _chart->addAxis(axisY, Qt::AlignLeft);
-      _yAxisLeft = axisY;
-
-      if (_showYticks == HIDE_TICK)
-        axisY->setLabelsVisible(false);
-    } else if (_showYticks ==
-               SHOW_CUSTOM_TICK) // this is for user defined ticks
-    {
-      categoryY = new QtCharts::QCategoryAxis();
-      categoryY->setGridLineVisible(_enableGrid);
-      categoryY->setLinePen(axisPen);
+    /* finish(): waits for every queued frame to be written.
+     */
+    void finish() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done = true;
+      }
+      _ready.notify_all();
+      for (std::thread &t : _pool)
+        t.join();
+      _pool.clear();
+    }
 
-      if (_showYticks && _yTicks.size() > 0)
-        for (int i = 0; i < _yTicks.size(); i++) {
-#if (DEBUG > 1) && (DEBUG < 3)
-          qDebug() << "show(): ytick[" << i << "]=(" << _yTicks[i].second
-                   << " , " << _yTicks[i].first << ")";
-#endif
-          categoryY->append(_yTicks[i].first, _yTicks[i].second);
+    int saved() const { return _saved; }
+    int failed() const { return _failed; }
+    int dropped() const { return _dropped; }
+
+  private:
+    void _work() {
+      for (;;) {
+        std::pair<int, QImage> job;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _ready.wait(lock, [&]() { return !_queue.empty() || _done; });
+          if (_queue.empty())
+            return;
+          job = _queue.front();
+          _queue.pop_front();
         }
 
-      categoryY->setRange(_yMin, _yMax);
-      categoryY->setTickCount(_yTicks.size());
-      if (_yAxisLeft)
-        _chart->removeAxis(_yAxisLeft);
-      _chart->addAxis(categoryY, Qt::AlignLeft);
-      _yAxisLeft = categoryY;
+        const QString filename = _pattern.arg(job.first, 5, 10, QChar('0'));
+        if (job.second.save(filename)) {
+          _saved++;
+        } else {
+          qCritical() << "animate()!!! failed to write" << filename;
+          _failed++;
+        }
+      }
     }
 
-    /* Other possible customizations such as margins and background color */
-    // Remove (fat) exterior margins from QChart
-    _chart->layout()->setContentsMargins(0, 0, 0, 0);
-    _chart->setBackgroundRoundness(0);
+    QString _pattern;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::deque<std::pair<int, QImage>> _queue;
+    size_t _maxQueued;
+    bool _done;
+    std::vector<std::thread> _pool;
+    std::atomic<int> _saved, _failed, _dropped;
+  };
+
+  /* Animation: the state of animate().
+   */
+  struct Animation {
+    FrameCallback callback;
+    int interval;   // milliseconds between frames
+    int frames;     // frames to play, 0 for no limit
+    int next;       // number of the next frame
+    QTimer *timer;  // child of _chartView
+    QElapsedTimer clock;
+    qint64 totalNs; // time spent in frames so far
+    AnimationStats stats;
+    std::unique_ptr<FrameExporter> exporter;
+
+    Animation() : interval(0), frames(0), next(0), timer(NULL), totalNs(0) {}
+  };
+
+  /* _animationFrame(): draws the frame the clock is at. Frame i is due i + 1
+   * intervals after the start, when the timer ticks for the (i + 1)th time.
+   * Frames that became due while the previous one was drawn are skipped.
+   */
+  void _animationFrame() {
+    Animation &animation = *_animation;
+    const qint64 late = animation.clock.elapsed() - animation.interval;
+    const int due =
+        static_cast<int>(std::max<qint64>(0, late) / animation.interval);
+    if (due > animation.next) {
+      animation.stats.skipped += due - animation.next;
+      animation.next = due;
+    }
+    if (animation.frames > 0 && animation.next >= animation.frames) {
+      _finishAnimation();
+      return;
+    }
 
-    /* Add series of data */
-    _chart->removeAllSeries();
-    for (auto itr : _seriesVec) {
-      _chart->addSeries(itr.get());
-
-      if (_showXticks == SHOW_TICK || _showXticks == HIDE_TICK) {
-        itr->attachAxis(axisX);
-      } else if (_showXticks == SHOW_CUSTOM_TICK) {
-        itr->attachAxis(categoryX);
-      }
+    QElapsedTimer timer;
+    timer.start();
 
-      if (_showYticks == SHOW_TICK || _showYticks == HIDE_TICK) {
-        itr->attachAxis(axisY);
-      } else if (_showYticks == SHOW_CUSTOM_TICK) {
-        itr->attachAxis(categoryY);
-      }
+    bool more;
+    {
+      std::lock_guard<std::recursive_mutex> lock(_mutex);
+      more = animation.callback(*this, animation.next);
+      if (_hasData())
+        _buildChart();
     }
 
-    _chartView->setRenderHint(QPainter::Antialiasing);
-    _chartView->resize(600, 400);
+    if (animation.exporter)
+      animation.exporter->push(animation.next, _chartView->grab().toImage());
 
-    // Take a screenshot of the widget before it's destroyed
-    // so it can be saved later, when savefig() is invoked after show().
+    const qint64 ns = timer.nsecsElapsed();
+    animation.totalNs += ns;
+    animation.stats.maxFrameNs = std::max(animation.stats.maxFrameNs, ns);
+    animation.stats.frames++;
+    animation.next++;
 
-    _chartView->show();
+    if (!more || (animation.frames > 0 && animation.next >= animation.frames))
+      _finishAnimation();
+  }
 
-    // This loop blocks execution & waits for the window to be destroyed.
-    // However, is this chart is supposed to be a real widget, then do none of
-    // this.
-    if (!_isWidget) {
-      _pixmap = _chartView->grab();
-      _chartView->setAttribute(
-          Qt::WA_DeleteOnClose); // This deletes _chartView!
-      QEventLoop loop;
-      QObject::connect(_chartView, SIGNAL(destroyed()), &loop, SLOT(quit()));
-      loop.exec();
+  /* _finishAnimation(): stops the timer of animate() and waits for its frames
+   * to be written.
+   */
+  void _finishAnimation() {
+    Animation &animation = *_animation;
+    animation.timer->stop();
+    if (animation.exporter)
+      animation.exporter->finish();
+  }
 
-      // _chartView was automatically deleted. Release all the other resources!
-      //_seriesVec.clear();
-    }
+  /* _stopAnimation(): ends the last animate(), if it's still running.
+   */
+  void _stopAnimation() {
+    if (!_animation)
+      return;
 
-#if (DEBUG > 0) && (DEBUG < 2)
-    qDebug() << "show(): -----";
-#endif
+    delete _animation->timer;
+    _animation->timer = NULL;
+    if (_animation->exporter)
+      _animation->exporter->finish();
   }
 
-  void clear() { _seriesVec.clear(); }
+  /* _requestRedraw(): has the GUI thread bring the window of show_async() up
+   * to date. Requests made before the GUI thread gets to it are merged.
+   */
+  void _requestRedraw() {
+    if (!_window || _redrawPending.exchange(true))
+      return;
 
-private:
-  bool _is_marker(const QString &cmd) {
-    if (cmd == "-" || cmd == "--" || cmd == "." || cmd == "o" || cmd == "s")
-      return true;
+    const std::weak_ptr<char> alive = _alive;
+    _runOnGui([this, alive]() {
+      if (alive.expired()) // destroyed on the GUI thread meanwhile
+        return;
 
-    return false; // cmd is a label for the legend
+      std::lock_guard<std::recursive_mutex> lock(_mutex);
+      _redrawPending = false;
+      if (_chartView && _hasData()) {
+        _buildChart();
+        _startDrainTimer();
+      }
+    });
   }
 
-  void _check_cmds_are_good(const QString &cmd1, const QString &cmd2) {
-    if (_is_marker(cmd1) && !_is_marker(cmd2))
-      return;
+  /* GuiThread: the thread Madplotlib runs a QApplication on, for
+   * programs that didn't create one.
+   */
+  struct GuiThread {
+    QCoreApplication *app;
+    std::thread thread;
+
+    GuiThread() : app(NULL) {
+      std::mutex mutex;
+      std::condition_variable started;
+      std::unique_lock<std::mutex> lock(mutex);
+
+      thread = std::thread([&]() {
+        static int argc = 1;
+        static char name[] = "madplotlib";
+        static char *argv[] = {name, NULL};
+        QApplication application(argc, argv);
+        application.setQuitOnLastWindowClosed(false);
+
+        // published from inside exec(), so the loop is running once app is
+        // set, as _runOnGuiAndWait() expects
+        QMetaObject::invokeMethod(&application, [&]() {
+          std::lock_guard<std::mutex> lock(mutex);
+          app = &application;
+          started.notify_one();
+        }, Qt::QueuedConnection);
+        application.exec();
+      });
+
+      started.wait(lock, [&]() { return app != NULL; });
+    }
 
-    if (!_is_marker(cmd1) && _is_marker(cmd2))
-      return;
+    ~GuiThread() {
+      QMetaObject::invokeMethod(app, "quit", Qt::QueuedConnection);
+      thread.join();
+    }
+  };
 
-    qCritical() << "_check_cmds_are_good()!!! Only one marker and one label "
-                   "are allowed.";
-    exit(-1);
+  /* _guiApplication(): the application whose thread shows the windows of
+   * show_async(). Created on a thread of its own if there's none yet.
+   */
+  static QCoreApplication *_guiApplication() {
+    static std::mutex mutex;
+    static std::unique_ptr<GuiThread> gui;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!gui && !QCoreApplication::instance())
+      gui.reset(new GuiThread());
+    return gui ? gui->app : QCoreApplication::instance();
   }
 
-  void _parseLegend() {
-    if (!_legend.size())
-      return;
+  /* _runOnGui(): queues task to the event loop of the GUI thread. Tasks run
+   * in the order they were queued.
+   */
+  static void _runOnGui(std::function<void()> task) {
+    QMetaObject::invokeMethod(_guiApplication(), std::move(task),
+                              Qt::QueuedConnection);
+  }
 
-    QRegExp equalsRegex("(\\=)"); // RegEx for '='
-    QStringList wordList = _legend.split(equalsRegex);
+  /* _runOnGuiAndWait(): runs task on the GUI thread and waits for it.
+   * The task runs inline when called from the GUI thread, or when the
+   * application of the caller isn't running its event loop (e.g. destructors
+   * at the end of main() after show_async()), as it would never be picked up.
+   */
+  static void _runOnGuiAndWait(const std::function<void()> &task) {
+    QCoreApplication *app = _guiApplication();
+    if (QThread::currentThread() == app->thread() ||
+        app->thread()->loopLevel() == 0) {
+      task();
+      return;
+    }
 
-    // step1: trim spaces
-    for (int i = 0; i < wordList.size(); i++)
-      wordList[i] = wordList[i].trimmed();
+    std::promise<void> done;
+    _runOnGui([&]() {
+      task();
+      done.set_value();
+    });
+    done.get_future().wait();
+  }
 
-    // step 2: delete empty strings
-    QMutableStringListIterator it(wordList); // pass list as argument
-    while (it.hasNext()) {
-      if (!it.next().size())
-        it.remove();
-    }
+  /* _decimateM4(): min/max decimation. x is split in columns pixel wide and
+   * for every run of consecutive points that fall on the same column only the
+   * first, last, min and max points are kept, in their original order. The
+   * rasterized line is identical to the one drawn from the full data set, so
+   * spikes and other extremes are never lost.
+   * Points outside [lo, hi] are gathered in two extra columns at each side.
+   */
+  template <class Dx, class Dy>
+  static void _decimateM4(QVector<QPointF> &points,
+                          const Eigen::ArrayBase<Dx> &x,
+                          const Eigen::ArrayBase<Dy> &y, qreal lo, qreal hi,
+                          int columns) {
+    const int n = x.rows();
+    const qreal scale = (hi > lo) ? columns / (hi - lo) : 0;
+
+    auto column = [&](qreal value) -> int {
+      qreal t = (value - lo) * scale;
+      if (!(t >= 0)) // also catches NaN
+        return -1;
+      if (t >= columns)
+        return columns;
+      return static_cast<int>(t);
+    };
+
+    points.clear();
+    points.reserve(4 * (columns + 2));
+
+    int i = 0;
+    while (i < n) {
+      const int col = column(x[i]);
+      int first = i, last = i, iMin = i, iMax = i;
+
+      int j = i + 1;
+      for (; j < n && column(x[j]) == col; j++) {
+        if (y[j] < y[iMin])
+          iMin = j;
+        if (y[j] > y[iMax])
+          iMax = j;
+        last = j;
+      }
 
-    int i = -1;
-    QStringList::iterator iter =
-        std::find(wordList.begin(), wordList.end(), "label");
-    if (iter != wordList.end())
-      i = iter - wordList.begin(); // if "loc" is in the list, i has the index
+      int idx[4] = {first, iMin, iMax, last};
+      std::sort(idx, idx + 4);
+      for (int k = 0; k < 4; k++)
+        if (k == 0 || idx[k] != idx[k - 1])
+          points.push_back(QPointF(x[idx[k]], y[idx[k]]));
 
-    // ok, "label" exists && there's another word after it on the list
-    if (i >= 0 && i + 1 < wordList.size())
-      _legend = wordList[i + 1];
-    else
-      _legend.clear();
+      i = j;
+    }
   }
 
-  QString _parseLegendPos(QString cmd) {
-    if (!cmd.size())
-      return QString();
-
-    QRegExp equalsRegex("(\\=)"); // RegEx for '='
-    QStringList wordList = cmd.split(equalsRegex);
+  /* _decimateLTTB(): Largest-Triangle-Three-Buckets downsampling to
+   * threshold points. The first and last points are always kept and every
+   * bucket in between keeps the point that forms the largest triangle with
+   * the previously kept point and the average of the next bucket. It
+   * preserves the visual shape well but, unlike M4, doesn't guarantee that
+   * every extreme survives.
+   */
+  template <class Dx, class Dy>
+  static void _decimateLTTB(QVector<QPointF> &points,
+                            const Eigen::ArrayBase<Dx> &x,
+                            const Eigen::ArrayBase<Dy> &y, int threshold) {
+    const int n = x.rows();
+    if (threshold >= n || threshold < 3) {
+      points.resize(n);
+      for (int i = 0; i < n; i++)
+        points[i] = QPointF(x[i], y[i]);
+      return;
+    }
 
-    // step1: trim spaces
-    for (int i = 0; i < wordList.size(); i++)
-      wordList[i] = wordList[i].trimmed();
+    points.clear();
+    points.reserve(threshold);
+
+    const double every = double(n - 2) / (threshold - 2);
+    int a = 0; // index of the last selected point
+    points.push_back(QPointF(x[0], y[0]));
+
+    for (int b = 0; b < threshold - 2; b++) {
+      // average of the next bucket is the third vertex of the triangle
+      int nextStart = static_cast<int>((b + 1) * every) + 1;
+      int nextEnd = std::min(static_cast<int>((b + 2) * every) + 1, n);
+      if (nextStart >= nextEnd) // last bucket: use the last point
+        nextStart = n - 1, nextEnd = n;
+
+      const int len = nextEnd - nextStart;
+      const qreal avgX = x.segment(nextStart, len).template cast<qreal>().mean();
+      const qreal avgY = y.segment(nextStart, len).template cast<qreal>().mean();
+
+      // pick the point of the current bucket with the largest triangle
+      const int start = static_cast<int>(b * every) + 1;
+      const int end = static_cast<int>((b + 1) * every) + 1;
+      const qreal ax = x[a], ay = y[a];
+      qreal maxArea = -1;
+      int selected = start;
+      for (int i = start; i < end; i++) {
+        qreal area =
+            std::abs((ax - avgX) * (y[i] - ay) - (ax - x[i]) * (avgY - ay));
+        if (area > maxArea) {
+          maxArea = area;
+          selected = i;
+        }
+      }
 
-    // step 2: delete empty strings
-    QMutableStringListIterator it(wordList); // pass list as argument
-    while (it.hasNext()) {
-      if (!it.next().size())
-        it.remove();
+      points.push_back(QPointF(x[selected], y[selected]));
+      a = selected;
     }
 
-    int i = -1;
-    QStringList::iterator iter =
-        std::find(wordList.begin(), wordList.end(), "loc");
-    if (iter != wordList.end())
-      i = iter - wordList.begin(); // if "loc" is in the list, i has the index
+    points.push_back(QPointF(x[n - 1], y[n - 1]));
+  }
 
-    // ok, "label" exists && there's another word after it on the list
-    if (i >= 0 && i + 1 < wordList.size())
-      return wordList[i + 1];
+  /* _parseLegendPos(): the alignment of the legend given as "loc=center
+   * right", or 0 if cmd isn't a valid position.
+   */
+  static int _parseLegendPos(const QString &cmd) {
+    const int equals = cmd.indexOf(QChar('='));
+    if (equals < 0 || cmd.left(equals).trimmed() != "loc") {
+      qCritical() << "legend()!!!" << cmd
+                  << " is not of the form loc=position.";
+      return 0;
+    }
 
-    return QString();
+    const QString loc = cmd.mid(equals + 1).trimmed();
+    if (loc == "lower center") // 9
+      return Qt::AlignBottom;
+    if (loc == "upper center") // 8
+      return Qt::AlignTop;
+    if (loc == "center right") // 7
+      return Qt::AlignRight;
+    if (loc == "center left") // 6
+      return Qt::AlignLeft;
+
+    qCritical() << "legend()!!!" << loc << " is not a valid legend position.";
+    return 0;
   }
 
-  QPixmap
-      _pixmap; // show() screenshots the widget, savefig() writes it on the disk
   QtCharts::QChart *_chart; // manages the graphical representation of the
                             // chart's series, legends & axes
   QtCharts::QChartView *_chartView; // standalone widget that can display charts
-  QMap<QString, std::shared_ptr<QtCharts::QXYSeries>>
-      _seriesVec; // every plot() creates a new series of data that is stored
-                  // here
+  QGraphicsScene *_scene; // holds the chart when it's rendered offscreen
+  // Every plot() creates a new series of data that is stored in _seriesVec,
+  // packed in no particular order. Handles go through _slots, so they stay
+  // valid when a removed series is replaced by the last one.
+  struct SeriesSlot {
+    int index;          // of the series in _seriesVec, -1 if the slot is free
+    quint32 generation; // bumped every time the slot is released
+    SeriesSlot() : index(-1), generation(0) {}
+  };
+  QVector<SeriesData> _seriesVec;
+  QVector<SeriesSlot> _slots;
+  QVector<int> _freeSlots;
+  QHash<QString, int> _labels; // slot of every series that has a label
+  QVector<ImageData> _images; // of hist2d(), hexbin() and imshow()
+
+  // Figures shown by show_async() are drawn by the GUI thread while other
+  // threads change them. _mutex is held by both, through FigureEdit.
+  mutable std::recursive_mutex _mutex;
+  std::shared_ptr<AsyncWindow> _window; // NULL unless shown by show_async()
+  std::atomic<bool> _redrawPending;
+  // Tasks queued to the GUI thread hold a weak_ptr to it. The destructor
+  // resets it on that thread, so the tasks still queued then do nothing.
+  std::shared_ptr<char> _alive;
+  std::vector<std::shared_ptr<QtCharts::QXYSeries>> _retiredSeries;
+
+  QTimer *_drainTimer; // drains the queues of ingest() on the GUI thread
+  std::unique_ptr<Animation> _animation; // the last animate()
+  Eigen::ArrayXf _drainX, _drainY; // samples taken out of a queue
 
   bool _isWidget; // true: show() doesn't block so this can be used as widget
   QString _legend;
-  QString _legendPos;
+  int _legendPos; // Qt::AlignmentFlag of the legend, 0 if not set
+
+  // decorations changed since _buildChart() last handed them to the chart
+  enum ChartPart {
+    TitleDirty = 1,
+    LegendDirty = 2,
+    XAxisDirty = 4,
+    YAxisDirty = 8,
+    AllDirty = TitleDirty | LegendDirty | XAxisDirty | YAxisDirty
+  };
+  int _dirtyParts;
+  qreal _shownRange[4]; // x and y ranges last given to the axes
+  qreal _xRange[2];     // range of the x axis, once rounded to nice numbers
+  QMetaObject::Connection _rangeConnection; // rangeChanged() of the x axis
+  QMetaObject::Connection _plotAreaConnection; // plotAreaChanged() of _chart
+  qreal _plotAreaRange[4]; // _shownRange of the last density image
+  bool _plotAreaDirty;     // a density series changed since the last image
+  bool _plotAreaShown;     // the plot area background is a density image
+  bool _useOpenGL;        // series are drawn with OpenGL inside the view
 
   QVector<QPair<QString, qreal>> _xTicks; // user defined <label, endValue>
                                           // ticks that replace default ticks
@@ -1025,15 +6094,312 @@ private:
                  // different colour
 
   bool _customLimits; // If the user has informed new limits through xlim(),
-                      // ylim(), or axis()
+                      // ylim(), or axis(). Otherwise they come from
+                      // _autoscale()
   qreal _xMin;        // X axis min limit
   qreal _xMax;        // X axis max limit
   qreal _yMin;        // Y axis min limit
   qreal _yMax;        // Y axis max limit
 
+  int _width;  // width of the chart in pixels, also used for decimation
+  int _height; // height of the chart in pixels
+  SharedAxis _sharedX; // set by Subplots for charts sharing their axes
+  SharedAxis _sharedY;
+
   bool _enableGrid; // flag that show/hides the background grid
   QtCharts::QAbstractAxis *_yAxisLeft;
   QtCharts::QAbstractAxis *_yAxisRight;
   QtCharts::QAbstractAxis *_xAxisBottom;
   QtCharts::QAbstractAxis *_xAxisTop;
 };
+
+/* Subplots: a grid of charts drawn as a single figure, made by
+ * Madplotlib::subplots(). Each chart is a Madplotlib of its own, filled
+ * through plot(), title() and friends as usual, but they all live in one
+ * scene: show() opens a single window on it, and render() or savefig()
+ * paint the whole grid in a single pass. The data of the charts (queues of
+ * ingest(), windows of mapped files, ranges of the axes) is prepared on
+ * worker threads first, only the Qt objects are built on the GUI thread.
+ * Charts without any data are left blank.
+ */
+class Subplots {
+public:
+  Subplots(int rows, int cols, bool sharex = false, bool sharey = false)
+      : _rows(std::max(1, rows)), _cols(std::max(1, cols)), _sharex(sharex),
+        _sharey(sharey), _scene(NULL), _view(NULL) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "Subplots(): rows=" << rows << " cols=" << cols
+             << " sharex=" << sharex << " sharey=" << sharey;
+#endif
+    if (rows <= 0 || cols <= 0)
+      qCritical() << "subplots(): rows and cols must be > 0 but they are"
+                  << rows << "and" << cols;
+
+    _width = _cols * DEFAULT_PANEL_WIDTH;
+    _height = _rows * DEFAULT_PANEL_HEIGHT;
+    for (int i = 0; i < _rows * _cols; i++) {
+      _charts.emplace_back(new Madplotlib());
+      _charts.back()->_width = DEFAULT_PANEL_WIDTH;
+      _charts.back()->_height = DEFAULT_PANEL_HEIGHT;
+    }
+  }
+
+  ~Subplots() {
+    _charts.clear(); // takes their charts off the scene
+    delete _view;
+    delete _scene;
+  }
+
+  Subplots(const Subplots &) = delete;
+  Subplots &operator=(const Subplots &) = delete;
+
+  /* operator(): the chart at row and col, counted from the top left.
+   */
+  Madplotlib &operator()(int row, int col) {
+    return *_charts[row * _cols + col];
+  }
+
+  /* operator[]: the chart number i, counted row by row.
+   */
+  Madplotlib &operator[](int i) { return *_charts[i]; }
+
+  int rows() const { return _rows; }
+  int cols() const { return _cols; }
+
+  /* show(): displays the grid in a single window. Like Madplotlib::show(),
+   * it blocks until the window is closed.
+   */
+  void show() {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "Subplots::show(): " << _rows << "x" << _cols;
+#endif
+    if (!_build(_width, _height))
+      return;
+
+    if (!_view) {
+      _view = new QGraphicsView(_scene);
+      _view->setRenderHint(QPainter::Antialiasing);
+    }
+    _view->setSceneRect(QRectF(0, 0, _width, _height));
+    _view->resize(_width, _height);
+    _view->show();
+
+    QEventLoop loop;
+    MadplotlibCloseWatcher watcher([&loop]() { loop.quit(); });
+    _view->installEventFilter(&watcher);
+    loop.exec();
+    _view->removeEventFilter(&watcher);
+  }
+
+  /* savefig(): saves the grid as a raster image on the disk, with the same
+   * arguments as Madplotlib::savefig(). width and height are the ones of
+   * the whole grid.
+   */
+  void savefig(const QString &filename, int width = 0, int height = 0,
+               int dpi = DEFAULT_DPI) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "Subplots::savefig(): filename=" << filename
+             << " width=" << width << " height=" << height << " dpi=" << dpi;
+#endif
+    const QString suffix = QFileInfo(filename).suffix().toLower();
+    if (suffix == "svg" || suffix == "pdf") {
+      qCritical() << "savefig()!!! subplots are only saved as raster images.";
+      return;
+    }
+
+    QImage image = render(width, height, dpi);
+    if (image.isNull())
+      return;
+
+    if (!image.save(filename))
+      qCritical() << "savefig()!!! failed to write" << filename;
+  }
+
+  /* render(): draws the whole grid on an image, without any window, in a
+   * single pass over the scene. The arguments have the same meaning as in
+   * savefig().
+   */
+  QImage render(int width = 0, int height = 0, int dpi = DEFAULT_DPI) {
+#if (DEBUG > 0) && (DEBUG < 2)
+    qDebug() << "Subplots::render(): width=" << width << " height=" << height
+             << " dpi=" << dpi;
+#endif
+    if (dpi <= 0) {
+      qCritical() << "render()!!! dpi must be > 0 but it is " << dpi;
+      return QImage();
+    }
+
+    const qreal scale = qreal(dpi) / DEFAULT_DPI;
+    if (width <= 0)
+      width = qRound(_width * scale);
+    if (height <= 0)
+      height = qRound(_height * scale);
+
+    // lay the charts out at their logical size, the painter scales them
+    const QRectF source(0, 0, width / scale, height / scale);
+    if (!_build(source.width(), source.height()))
+      return QImage();
+
+    QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+    const int dotsPerMeter = qRound(dpi / 0.0254);
+    image.setDotsPerMeterX(dotsPerMeter);
+    image.setDotsPerMeterY(dotsPerMeter);
+    image.fill(Qt::white);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    _scene->render(&painter, QRectF(0, 0, width, height), source,
+                   Qt::IgnoreAspectRatio);
+    painter.end();
+
+    // the charts go back to the size of the window
+    if (_view)
+      _build(_width, _height);
+    return image;
+  }
+
+private:
+  /* _build(): brings the charts up to date for a grid of width x height and
+   * lays them out on the scene. The steps of Madplotlib::_buildChart() that
+   * deal with data, the queues, mapped windows and ranges first, then the
+   * points for the range of the axes, are run on worker threads. The Qt
+   * objects are set up on this thread in between, the axes of the first
+   * chart before the others when they share axes. Returns false if no chart
+   * has any data.
+   */
+  bool _build(qreal width, qreal height) {
+    const qreal cellWidth = width / _cols;
+    const qreal cellHeight = height / _rows;
+    std::vector<Madplotlib *> charts; // the ones with data
+    for (const std::unique_ptr<Madplotlib> &plt : _charts) {
+      plt->_width = qRound(cellWidth);
+      plt->_height = qRound(cellHeight);
+      if (plt->_hasData())
+        charts.push_back(plt.get());
+    }
+
+    if (charts.empty()) {
+      qCritical() << "show()!!! Must set the data with plot() on a chart of "
+                     "subplots() before show().";
+      return false;
+    }
+
+    _forEach(charts, &Madplotlib::_prepareChart);
+
+    // the first chart rounds the shared range to nice numbers, the others
+    // reuse the range and ticks of its axis
+    if (_sharex)
+      _shareRange(charts, true);
+    if (_sharey)
+      _shareRange(charts, false);
+    std::vector<bool> newAxis(charts.size());
+    newAxis[0] = charts[0]->_buildFrame();
+    if (_sharex)
+      _shareTicks(charts, true);
+    if (_sharey)
+      _shareTicks(charts, false);
+    for (size_t i = 1; i < charts.size(); i++)
+      newAxis[i] = charts[i]->_buildFrame();
+
+    _forEach(charts, &Madplotlib::_makePoints);
+    for (size_t i = 0; i < charts.size(); i++)
+      charts[i]->_buildSeries(newAxis[i]);
+
+    if (!_scene)
+      _scene = new QGraphicsScene();
+    for (int i = 0; i < _rows * _cols; i++) {
+      Madplotlib &plt = *_charts[i];
+      if (!plt._chart)
+        continue;
+
+      if (plt._chart->scene() != _scene)
+        _scene->addItem(plt._chart);
+      plt._chart->setVisible(plt._hasData());
+      plt._chart->setPos((i % _cols) * cellWidth, (i / _cols) * cellHeight);
+      plt._chart->resize(cellWidth, cellHeight);
+      plt._chart->layout()->activate();
+    }
+    _scene->setSceneRect(0, 0, width, height);
+    return true;
+  }
+
+  /* _forEach(): runs step on every chart. Workers take the charts one at a
+   * time, each under the lock of its chart.
+   */
+  static void _forEach(const std::vector<Madplotlib *> &charts,
+                       void (Madplotlib::*step)()) {
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+      for (size_t i; (i = next++) < charts.size();) {
+        std::lock_guard<std::recursive_mutex> lock(charts[i]->_mutex);
+        (charts[i]->*step)();
+      }
+    };
+    const int threads =
+        std::max(1, std::min<int>(QThread::idealThreadCount(), charts.size()));
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+      pool.emplace_back(std::cref(work));
+    work();
+    for (std::thread &t : pool)
+      t.join();
+  }
+
+  /* _shareRange(): gives the first of charts the x (or y) range of the data
+   * of all of them, to be rounded to nice numbers unless one of them has
+   * limits set by xlim(), ylim() or axis().
+   */
+  static void _shareRange(const std::vector<Madplotlib *> &charts, bool x) {
+    Madplotlib::SharedAxis range;
+    range.active = true;
+    range.nice = true;
+    range.min = std::numeric_limits<qreal>::infinity();
+    range.max = -range.min;
+    for (const Madplotlib *plt : charts) {
+      range.nice = range.nice && !plt->_customLimits;
+      range.min = std::min(range.min, x ? plt->_xMin : plt->_yMin);
+      range.max = std::max(range.max, x ? plt->_xMax : plt->_yMax);
+    }
+
+    Madplotlib &first = *charts[0];
+    range.tickCount = x ? first._xTickCount : first._yTickCount;
+    (x ? first._sharedX : first._sharedY) = range;
+  }
+
+  /* _shareTicks(): gives the other charts the x (or y) axis the first one
+   * ended up with. Their axes only get their settings applied again when
+   * it changed.
+   */
+  static void _shareTicks(const std::vector<Madplotlib *> &charts, bool x) {
+    const QtCharts::QValueAxis *axis = static_cast<QtCharts::QValueAxis *>(
+        x ? charts[0]->_xAxisBottom : charts[0]->_yAxisLeft);
+    Madplotlib::SharedAxis ticks;
+    ticks.active = true;
+    ticks.min = axis->min();
+    ticks.max = axis->max();
+    ticks.tickCount = axis->tickCount();
+
+    for (size_t i = 1; i < charts.size(); i++) {
+      Madplotlib::SharedAxis &shared =
+          x ? charts[i]->_sharedX : charts[i]->_sharedY;
+      if (!shared.active || shared.tickCount != ticks.tickCount)
+        charts[i]->_dirtyParts |=
+            x ? Madplotlib::XAxisDirty : Madplotlib::YAxisDirty;
+      shared = ticks;
+    }
+  }
+
+  int _rows, _cols;
+  bool _sharex, _sharey;
+  int _width;  // width of the grid in pixels, when shown
+  int _height; // height of the grid in pixels, when shown
+  std::vector<std::unique_ptr<Madplotlib>> _charts; // row by row
+  QGraphicsScene *_scene; // holds the charts of every cell
+  QGraphicsView *_view;   // the window of show()
+};
+
+inline std::unique_ptr<Subplots> Madplotlib::subplots(int rows, int cols,
+                                                      bool sharex,
+                                                      bool sharey) {
+  return std::unique_ptr<Subplots>(new Subplots(rows, cols, sharex, sharey));
+}
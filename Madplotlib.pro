@@ -1,6 +1,6 @@
 INCLUDEPATH += "C:\\Eigen"
 
-QT += widgets charts
+QT += widgets charts svg
 
 SOURCES += \
     eigen_tests.cpp
@@ -20,6 +20,8 @@
 #include "Madplotlib.h"
 
 #include <QApplication>
+#include <QDir>
+#include <QFile>
 
 // Uncomment the line below to save each chart as PNG image
 #define SCRSHOT
@@ -125,8 +127,8 @@ void test4()
     plt.title("Test 4: Random Scatter Plot");
     plt.locator_params("x", 10);
     plt.axis(-25, 100, -25, 100);
-    plt.plot(x, y, marker=QString("o"), 0.7f, QColor(255, 0, 0), 8.0f); // red, 30% transparent, markersize 8
-    plt.plot(x2, y2, marker=QString("o"), 0.5f, QColor(0, 0, 255));     // blue, 50% transparent
+    plt.plot(x, y, marker=QString("o"), alpha=0.7, color=QColor(255, 0, 0), markersize=8.0); // red, 30% transparent
+    plt.plot(x2, y2, marker=QString("o"), alpha=0.5, color=QColor(0, 0, 255));              // blue, 50% transparent
     plt.show();
 
 #ifdef SCRSHOT
@@ -309,8 +311,9 @@ void test9()
     plt.xlabel("Fox News Shares");
     plt.ylabel("Fox News Likes");
 
-    plt.plot(x, y, QColor(169, 206, 0)); // plot green line
-    plt.plot(x, y, QString("o"), QColor(255, 255, 255), 2, QColor(169, 206, 0), 6.5f); // plot markers, linewith=2, markersize=6.5
+    plt.plot(x, y, color=QColor(169, 206, 0)); // plot green line
+    plt.plot(x, y, QString("o"), color=QColor(255, 255, 255), linewidth=2,
+             edgecolor=QColor(169, 206, 0), markersize=6.5); // plot markers
     plt.show();
 
 #ifdef SCRSHOT
@@ -355,6 +358,230 @@ void test10()
 #endif
 }
 
+/* Use case that renders a batch of charts straight to PNG files, without windows.
+ * + renderBatch() calls each Figure on a worker thread to describe a chart,
+ *                 paints the charts on the GUI thread and saves them on worker threads.
+ * + every BatchResult reports how long each stage took.
+ */
+void test11()
+{
+    const int count = 8;
+
+    QVector<Madplotlib::Figure> figures;
+    QStringList filenames;
+    for (int i = 0; i < count; i++)
+    {
+        figures.push_back([i](Madplotlib& plt)
+        {
+            Eigen::ArrayXf x = Eigen::ArrayXf::LinSpaced(100000, 0, 10);
+            Eigen::ArrayXf y = (x * (i + 1)).sin() * x;
+
+            plt.title(QString("Test 11: Batch Figure %1").arg(i));
+            plt.plot(x, y, decimate=QString("m4"));
+        });
+        filenames.push_back(QString("test11_%1.png").arg(i));
+    }
+
+    QVector<Madplotlib::BatchResult> results = Madplotlib::renderBatch(figures, filenames);
+
+    for (int i = 0; i < results.size(); i++)
+        qInfo() << filenames[i] << "prepare:" << results[i].prepareNs / 1000 << "us"
+                << "render:" << results[i].renderNs / 1000 << "us"
+                << "encode:" << results[i].encodeNs / 1000 << "us";
+}
+
+/* Use case: histogram of random samples, updated as more samples arrive.
+ * + hist() counts 1e6 samples into 30 bins of the same width over [0.7, 1.0],
+ *          on several threads. Samples equal to 0.7 and 1.0 fall in the
+ *          first and last bins, the others out of the range aren't counted.
+ * + hist(handle, x) adds the counts of more samples to the same bars.
+ */
+void test12()
+{
+    const int count = 1000000;
+    Eigen::ArrayXf x = Eigen::ArrayXf::Random(count) * 0.2f + 0.85f;
+    x.head(1000).setConstant(0.7f);
+
+    Madplotlib plt;
+    plt.title("Test 12: Histogram");
+    SeriesHandle handle = plt.hist(x, bins=30, range=qMakePair(0.7, 1.0),
+                                   label=QString("samples"));
+
+    Eigen::ArrayXf more = Eigen::ArrayXf::Random(count) * 0.05f + 0.8f;
+    plt.hist(handle, more);
+    plt.show();
+
+#ifdef SCRSHOT
+    plt.savefig("test12.png");
+#endif
+}
+
+/* Use case: 2D histograms of a cloud of points, on square and hexagonal bins.
+ * + hist2d() counts 1e6 points into 50x50 bins, on several threads, and draws
+ *            the counts as an image under the series.
+ * + hexbin() does the same with 40 hexagons across the x range.
+ */
+void test13()
+{
+    const int count = 1000000;
+    Eigen::ArrayXf x = Eigen::ArrayXf::Random(count) * 2.f;
+    Eigen::ArrayXf y = x * 0.5f + Eigen::ArrayXf::Random(count);
+
+    Madplotlib plt;
+    plt.title("Test 13: 2D Histogram");
+    plt.hist2d(x, y, 50, "plasma");
+    plt.show();
+
+    Madplotlib plt2;
+    plt2.title("Test 13: Hexagonal Bins");
+    plt2.hexbin(x, y, 40);
+    plt2.show();
+
+#ifdef SCRSHOT
+    plt.savefig("test13.png");
+    plt2.savefig("test13_hexbin.png");
+#endif
+}
+
+/* Use case: heatmap of a 2D array.
+ * + imshow() colors every value of an ArrayXXf through a colormap, row 0 at
+ *            the bottom. The bounds of the colormap are the ones of z.
+ */
+void test14()
+{
+    const int rows = 200, cols = 300;
+    Eigen::ArrayXXf z(rows, cols);
+    for (int c = 0; c < cols; c++)
+        for (int r = 0; r < rows; r++)
+            z(r, c) = std::sin(c * 0.05f) * std::cos(r * 0.05f);
+
+    Madplotlib plt;
+    plt.title("Test 14: Heatmap");
+    plt.imshow(z, "hot");
+    plt.show();
+
+#ifdef SCRSHOT
+    plt.savefig("test14.png");
+#endif
+}
+
+/* Use case: line charts of 1e6 noisy samples, reduced before they reach Qt.
+ * + decimate="m4" keeps the first, last, min and max points of every pixel
+ *                 column, so the line looks the same as the full one.
+ * + decimate="lttb" keeps the points that best preserve the shape of the line.
+ */
+void test15()
+{
+    const int count = 1000000;
+    Eigen::ArrayXf x = Eigen::ArrayXf::LinSpaced(count, 0, 100);
+    Eigen::ArrayXf y = x.sin() + Eigen::ArrayXf::Random(count) * 0.2f;
+
+    Madplotlib plt;
+    plt.title("Test 15: M4 and LTTB Decimation");
+    plt.plot(x, y, decimate=QString("m4"), label=QString("m4"));
+    plt.plot(x, y + 2.f, decimate=QString("lttb"), label=QString("lttb"));
+    plt.show();
+
+#ifdef SCRSHOT
+    plt.savefig("test15.png");
+#endif
+}
+
+/* Use case: a strip chart that only shows the latest samples.
+ * + plot(y, capacity=) makes a ring buffer of 2000 samples.
+ * + append() adds blocks of samples, dropping the oldest ones in O(1).
+ */
+void test16()
+{
+    Madplotlib plt;
+    plt.title("Test 16: Ring Buffer");
+    SeriesHandle handle = plt.plot(Eigen::ArrayXf::Zero(1), capacity=2000);
+
+    const int block = 100;
+    for (int i = 0; i < 50; i++)
+    {
+        Eigen::ArrayXf t = Eigen::ArrayXf::LinSpaced(block, i * block, (i + 1) * block - 1);
+        plt.append(handle, (t * 0.02f).sin() + Eigen::ArrayXf::Random(block) * 0.1f);
+    }
+    plt.show();
+
+#ifdef SCRSHOT
+    plt.savefig("test16.png");
+#endif
+}
+
+/* Use case that saves a chart as vector documents, without windows.
+ * + savefig() writes an SVG or a PDF file when the name ends with .svg or
+ *             .pdf. Long series are decimated before they're painted.
+ */
+void test17()
+{
+    Eigen::ArrayXf x = Eigen::ArrayXf::LinSpaced(100000, 0, 10);
+    Eigen::ArrayXf y = x.sin() * x;
+
+    Madplotlib plt;
+    plt.title("Test 17: Vector Output");
+    plt.plot(x, y, decimate=QString("m4"), label=QString("x sin(x)"));
+    plt.savefig("test17.svg");
+    plt.savefig("test17.pdf");
+}
+
+/* Use case: a file of samples bigger than what should be loaded in memory.
+ * + MappedArray::raw() maps a file of float32 samples and indexes it in the
+ *                      background.
+ * + plot() only reads the pages of the range shown: zoom in with the mouse
+ *          to read the samples of a narrower window of the file.
+ */
+void test18()
+{
+    const int count = 10000000;
+    const QString filename = QDir::temp().filePath("madplotlib_test18.f32");
+    {
+        Eigen::ArrayXf y = Eigen::ArrayXf::LinSpaced(count, 0, 1000).sin() +
+                           Eigen::ArrayXf::Random(count) * 0.1f;
+        QFile file(filename);
+        if (!file.open(QIODevice::WriteOnly))
+            return;
+        file.write(reinterpret_cast<const char*>(y.data()), count * sizeof(float));
+    }
+
+    std::shared_ptr<MappedArray> samples = MappedArray::raw(filename);
+    if (!samples)
+        return;
+
+    Madplotlib plt;
+    plt.title("Test 18: Memory Mapped File");
+    plt.plot(samples, label=QString("samples"));
+    plt.show();
+
+#ifdef SCRSHOT
+    plt.savefig("test18.png");
+#endif
+}
+
+/* Use case: zooming into 1e7 samples.
+ * + decimate="lod" builds a min/max pyramid of the samples once, so every
+ *                  view only queries its own range.
+ * + xlim() opens the chart zoomed in; drag a rubber band or use the wheel to
+ *          zoom, the right button to zoom out and the middle one to pan.
+ */
+void test19()
+{
+    const int count = 10000000;
+    Eigen::ArrayXf x = Eigen::ArrayXf::LinSpaced(count, 0, 1000);
+    Eigen::ArrayXf y = (x * 3.f).sin() * (x * 0.01f).cos() + Eigen::ArrayXf::Random(count) * 0.05f;
+
+    Madplotlib plt;
+    plt.title("Test 19: Level of Detail");
+    plt.plot(x, y, decimate=QString("lod"));
+    plt.xlim(400, 410);
+    plt.show();
+
+#ifdef SCRSHOT
+    plt.savefig("test19.png");
+#endif
+}
+
 void run_test(int id)
 {
     if (id == 0 || id == 1)
@@ -386,6 +613,33 @@ void run_test(int id)
 
     if (id == 0 || id == 10)
         test10();
+
+    if (id == 0 || id == 11)
+        test11();
+
+    if (id == 0 || id == 12)
+        test12();
+
+    if (id == 0 || id == 13)
+        test13();
+
+    if (id == 0 || id == 14)
+        test14();
+
+    if (id == 0 || id == 15)
+        test15();
+
+    if (id == 0 || id == 16)
+        test16();
+
+    if (id == 0 || id == 17)
+        test17();
+
+    if (id == 0 || id == 18)
+        test18();
+
+    if (id == 0 || id == 19)
+        test19();
 }
 
 void run_test(int begin, int end)
@@ -0,0 +1,286 @@
+/* Copyright (C) 2017 Karl Phillip Buhr <karlphillip@gmail.com>
+ *
+ * This work is licensed under the MIT License.
+ * To view a copy of this license, visit:
+ *      https://opensource.org/licenses/MIT
+ *
+ * This file is part of Madplotlib, a C++ library for building simple
+ * 2D plots inspired on matplotlib.
+ */
+/*
+ * madplotlib_bench times every stage a chart goes through, from the arrays
+ * handed to plotXY() to the PNG file written by savefig(), for 1e3 to 1e8
+ * points, line and scatter charts, and 1 to 500 series. It runs headless on
+ * the offscreen platform of Qt and prints its results as JSON, so they can
+ * be compared from one release to the next:
+ *
+ *     madplotlib_bench --max-points 1e7 --output bench.json
+ *
+ * Stages, in milliseconds (the median of the runs of a case):
+ *     ingest:  plotXY() of every series of the chart;
+ *     extents: axis() measuring the bounds of every series again, which
+ *              happens once a bounded series drops samples;
+ *     scene:   show() building the chart and its view, up to the end of
+ *              the first paint of the view;
+ *     raster:  render() painting the chart on an image;
+ *     encode:  writing the image as PNG, which completes savefig().
+ */
+
+#include <Eigen/Dense>
+
+#include "Madplotlib.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QGraphicsView>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <cstdio>
+
+/* Case: one chart of the benchmark.
+ */
+struct Case
+{
+    QString kind;  // "line" or "scatter"
+    int series;    // number of series on the chart
+    qint64 points; // points of every series
+};
+
+/* Stages: the time spent in each stage by one run of a case.
+ */
+struct Stages
+{
+    double ingest, extents, scene, raster, encode;
+};
+
+static double elapsedMs(const QElapsedTimer& timer)
+{
+    return timer.nsecsElapsed() / 1e6;
+}
+
+/* PaintWatcher: tells whether the widget it watches got a paint event. The
+ * event is painted as soon as the filter returns.
+ */
+class PaintWatcher : public QObject
+{
+public:
+    PaintWatcher() : painted(false) {}
+
+    bool painted;
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override
+    {
+        if (event->type() == QEvent::Paint)
+            painted = true;
+        return QObject::eventFilter(watched, event);
+    }
+};
+
+/* waitFirstPaint(): processes events until the view of a widget figure,
+ * the only window of the application, is painted for the first time.
+ * Returns false if it isn't after 5 seconds.
+ */
+static bool waitFirstPaint()
+{
+    const int timeoutMs = 5000;
+    QGraphicsView* view = nullptr;
+    for (QWidget* widget : QApplication::topLevelWidgets())
+        if (!view)
+            view = qobject_cast<QGraphicsView*>(widget);
+    if (!view)
+        return false;
+
+    PaintWatcher watcher;
+    QWidget* viewport = view->viewport();
+    viewport->installEventFilter(&watcher);
+
+    // pending layouts first, then a paint right away rather than on the next
+    // update request
+    QApplication::processEvents();
+    if (!watcher.painted)
+        viewport->repaint();
+
+    QElapsedTimer wait;
+    wait.start();
+    while (!watcher.painted && wait.elapsed() < timeoutMs)
+        QApplication::processEvents(QEventLoop::AllEvents, 10);
+
+    viewport->removeEventFilter(&watcher);
+    return watcher.painted;
+}
+
+/* run(): goes once through every stage of c, with the same x and y for all
+ * of its series.
+ */
+static Stages run(const Case& c, const Eigen::ArrayXf& xs, const Eigen::ArrayXf& ys,
+                  const QString& decimation, const QString& png)
+{
+    const QString format = (c.kind == "scatter") ? "o" : "-";
+    Stages stages;
+    QElapsedTimer timer;
+
+    {
+        // as a widget, show() builds the chart and its view without blocking
+        Madplotlib plt(true);
+
+        timer.start();
+        for (int i = 0; i < c.series; i++)
+            plt.plotXY(xs, ys, format, decimate=decimation);
+        stages.ingest = elapsedMs(timer);
+
+        timer.start();
+        plt.show();
+        if (!waitFirstPaint())
+            qCritical() << "madplotlib_bench: the view was never painted";
+        stages.scene = elapsedMs(timer);
+
+        timer.start();
+        QImage image = plt.render();
+        stages.raster = elapsedMs(timer);
+
+        timer.start();
+        if (!image.save(png))
+            qCritical() << "madplotlib_bench: failed to write" << png;
+        stages.encode = elapsedMs(timer);
+    }
+
+    // the view of a widget belongs to the application, which is done with it
+    qDeleteAll(QApplication::topLevelWidgets());
+
+    {
+        // A bounded series that drops a sample measures all of its bounds
+        // again the next time they are needed. Only its y samples are kept:
+        // x is at a fixed step, and its points are decimated since they are
+        // never drawn here, or 1e8 points would take gigabytes.
+        Madplotlib plt;
+        for (int i = 0; i < c.series; i++)
+        {
+            SeriesHandle handle =
+                plt.plotXY(Eigen::ArrayXd::LinSpaced(c.points, 0, 1), ys, "-",
+                           capacity=int(c.points), decimate=QString("m4"));
+            plt.append(handle, ys.tail(1));
+        }
+
+        qreal xMin, xMax, yMin, yMax;
+        timer.start();
+        plt.axis(&xMin, &xMax, &yMin, &yMax);
+        stages.extents = elapsedMs(timer);
+    }
+
+    return stages;
+}
+
+/* median(): the median of the values of stage over runs.
+ */
+static double median(const std::vector<Stages>& runs, double Stages::*stage)
+{
+    std::vector<double> values;
+    for (const Stages& s : runs)
+        values.push_back(s.*stage);
+
+    std::sort(values.begin(), values.end());
+    const size_t n = values.size();
+    return (n % 2) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+int main(int argc, char* argv[])
+{
+    // no display is needed, unless another platform is asked for
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    QApplication::setApplicationName("madplotlib_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the stages of Madplotlib charts and prints them as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption maxPointsOption("max-points", "Largest number of points per series, up to 1e8.", "n", "1e8");
+    QCommandLineOption repeatsOption("repeats", "Runs of every case below 1e6 points, whose median is kept.", "n", "5");
+    QCommandLineOption decimateOption("decimate", "Decimation of the line series: none, m4, lttb or lod.", "name", "m4");
+    QCommandLineOption outputOption("output", "Writes the JSON to file instead of the standard output.", "file");
+    parser.addOption(maxPointsOption);
+    parser.addOption(repeatsOption);
+    parser.addOption(decimateOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    const double maxPoints = parser.value(maxPointsOption).toDouble();
+    const int repeats = std::max(1, parser.value(repeatsOption).toInt());
+    const QString decimation = parser.value(decimateOption);
+
+    QTemporaryDir dir;
+    const QString png = dir.filePath("madplotlib_bench.png");
+
+    // Every size is plotted as a line and a scatter chart of a single series,
+    // 1e4 points also by more series.
+    QVector<Case> cases;
+    for (qint64 points = 1000; points <= 100000000 && points <= maxPoints; points *= 10)
+    {
+        for (const QString& kind : QStringList({"line", "scatter"}))
+        {
+            cases.push_back(Case{kind, 1, points});
+            if (points == 10000)
+                for (int series : {10, 100, 500})
+                    cases.push_back(Case{kind, series, points});
+        }
+    }
+
+    QJsonArray results;
+    Eigen::ArrayXf xs, ys;
+    for (const Case& c : cases)
+    {
+        if (xs.rows() != c.points)
+        {
+            xs = Eigen::ArrayXf::LinSpaced(c.points, 0, 1);
+            ys = (xs * 50).sin() + Eigen::ArrayXf::Random(c.points) * 0.1f;
+        }
+
+        const int runs = (c.points * c.series >= 1000000) ? 1 : repeats;
+        qInfo() << "madplotlib_bench:" << c.kind << c.series << "series of" << c.points
+                << "points," << runs << "run(s)";
+
+        std::vector<Stages> stages;
+        for (int i = 0; i < runs; i++)
+            stages.push_back(run(c, xs, ys, decimation, png));
+
+        QJsonObject result;
+        result["kind"] = c.kind;
+        result["series"] = c.series;
+        result["points"] = double(c.points);
+        result["runs"] = runs;
+        result["ingest_ms"] = median(stages, &Stages::ingest);
+        result["extents_ms"] = median(stages, &Stages::extents);
+        result["scene_ms"] = median(stages, &Stages::scene);
+        result["raster_ms"] = median(stages, &Stages::raster);
+        result["encode_ms"] = median(stages, &Stages::encode);
+        results.append(result);
+    }
+
+    QJsonObject root;
+    root["benchmark"] = "madplotlib_bench";
+    root["qt"] = qVersion();
+    root["threads"] = QThread::idealThreadCount();
+    root["decimate"] = decimation;
+    root["results"] = results;
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (!parser.isSet(outputOption))
+    {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        return 0;
+    }
+
+    QFile file(parser.value(outputOption));
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size())
+    {
+        qCritical() << "madplotlib_bench: failed to write" << file.fileName();
+        return 1;
+    }
+    return 0;
+}